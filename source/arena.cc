@@ -0,0 +1,111 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2009-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+
+#define HUGESIZE (2 << 20)
+
+
+bool Arena::_hugepages = false;
+
+
+Arena::Arena (size_t size) :
+    _data (0),
+    _size (round (size)),
+    _used (0),
+    _mapped (0),
+    _huge (false)
+{
+    void    *p;
+    size_t   n;
+
+    p = MAP_FAILED;
+    if (_hugepages)
+    {
+        n = (_size + HUGESIZE - 1) & ~(size_t)(HUGESIZE - 1);
+#ifdef MAP_HUGETLB
+        p = mmap (0, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) _huge = true;
+#endif
+#ifdef MADV_HUGEPAGE
+        if (p == MAP_FAILED)
+        {
+            // Transparent hugepages are only used for aligned
+            // ranges of at least one hugepage, so map twice
+            // the size and use an aligned part of it.
+            p = mmap (0, n + HUGESIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p != MAP_FAILED)
+            {
+                _data = (char *)(((size_t) p + HUGESIZE - 1) & ~(size_t)(HUGESIZE - 1));
+                if (_data > (char *) p) munmap (p, _data - (char *) p);
+                munmap (_data + n, (char *) p + HUGESIZE - _data);
+                p = _data;
+                _huge = ! madvise (p, n, MADV_HUGEPAGE);
+            }
+        }
+#endif
+    }
+    if (p == MAP_FAILED)
+    {
+        n = sysconf (_SC_PAGESIZE);
+        n = (_size + n - 1) & ~(n - 1);
+        p = mmap (0, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+        {
+            fprintf (stderr, "Can't allocate %zu bytes.\n", n);
+            exit (1);
+        }
+    }
+    _data = (char *) p;
+    _mapped = n;
+
+    // Prefault all pages. The block is zeroed by mmap(), this
+    // makes sure the pages are actually there.
+    memset (_data, 0, _mapped);
+}
+
+
+Arena::~Arena (void)
+{
+    munmap (_data, _mapped);
+}
+
+
+void *Arena::alloc (size_t size)
+{
+    void *p;
+
+    size = round (size);
+    if (_used + size > _size)
+    {
+        fprintf (stderr, "Arena overflow: %zu + %zu > %zu bytes.\n", _used, size, _size);
+        abort ();
+    }
+    p = _data + _used;
+    _used += size;
+    return p;
+}
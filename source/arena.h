@@ -0,0 +1,75 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2009-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+#ifndef __ARENA_H
+#define __ARENA_H
+
+
+#include <stddef.h>
+
+
+// A single block of memory for all the buffers of one Retuner and
+// its pitch detector. It is allocated at once and prefaulted, so the
+// audio thread never takes a page fault, and every allocation starts
+// on a cache line. Memory is only returned when the arena is deleted.
+//
+// If hugepages are enabled the block is taken from the hugetlb pool,
+// or if that fails transparent hugepages are requested for it. The
+// block is then rounded up to a full hugepage (2 MB on x86), so this
+// is best used with a small number of instances, or with mlockall().
+
+
+class Arena
+{
+public:
+
+    enum { ALIGN = 64 };
+
+    Arena (size_t size);
+    ~Arena (void);
+
+    // Returns 'size' bytes, aligned to ALIGN. The arena must be
+    // large enough, which is a programming error if it's not.
+    void *alloc (size_t size);
+
+    float *falloc (size_t n) { return (float *) alloc (n * sizeof (float)); }
+
+    // Space taken by an allocation of 'size' bytes, for sizing.
+    static size_t round (size_t size) { return (size + ALIGN - 1) & ~(size_t)(ALIGN - 1); }
+
+    // Applies to all arenas created after the call.
+    static void set_hugepages (bool v) { _hugepages = v; }
+
+    bool huge (void) const { return _huge; }
+
+private:
+
+    char           *_data;
+    size_t          _size;
+    size_t          _used;
+    size_t          _mapped;
+    bool            _huge;
+
+    static bool     _hugepages;
+};
+
+
+#endif
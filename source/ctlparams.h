@@ -0,0 +1,52 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2010 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+
+#ifndef __CTLPARAMS_H
+#define __CTLPARAMS_H
+
+
+// The parameters set in the main window, with their names in the
+// state file, on the control socket and for OSC. The ranges and
+// defaults are those of the GUI controls. The first five are in
+// the same order as Retuner::PAR_*.
+
+enum { CTL_TUNE, CTL_BIAS, CTL_FILT, CTL_CORR, CTL_OFFS, CTL_NOTES, NCTLPAR };
+
+static const struct
+{
+    const char  *name;
+    float        vmin;
+    float        vmax;
+    float        vdef;
+}
+ctlparams [NCTLPAR] =
+{
+    { "/autotune/tune",  400.0f, 480.0f, 440.0f },
+    { "/autotune/bias",    0.0f,   1.0f,   0.5f },
+    { "/autotune/filt",    0.02f,  0.5f,   0.1f },
+    { "/autotune/corr",    0.0f,   1.0f,   1.0f },
+    { "/autotune/offs",   -2.0f,   2.0f,   0.0f },
+    { "/autotune/notes",   0.0f, 4095.0f, 4095.0f }
+};
+
+
+#endif
@@ -0,0 +1,181 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2009-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+
+#include <string.h>
+#include <math.h>
+#include "dsptimer.h"
+
+
+static const char *names [Dsptimer::NSTAGE] = { "midi", "resample", "interp", "estimate", "output", "total" };
+
+
+Dsptimer::Dsptimer (void)
+{
+    int i, j;
+
+    _ncycle = 0;
+    _nxrun = 0;
+    for (i = 0; i < NSTAGE; i++)
+    {
+        _acc [i] = 0;
+        _sum [i] = 0;
+        _max [i] = 0;
+        for (j = 0; j < NBIN; j++) _hist [i][j] = 0;
+        for (j = 0; j < NRING; j++) _ring [j][i] = 0;
+    }
+    memset (_xruns, 0, sizeof (_xruns));
+}
+
+
+const char *Dsptimer::stage_name (int stage)
+{
+    return ((stage >= 0) && (stage < NSTAGE)) ? names [stage] : "?";
+}
+
+
+int Dsptimer::bin (uint32_t ns)
+{
+    int k;
+
+    // Four bins per octave, values below 4 ns go in the first ones.
+    if (ns < 4) return ns;
+    k = 31 - __builtin_clz (ns);
+    return 4 * (k - 1) + ((ns >> (k - 2)) & 3);
+}
+
+
+double Dsptimer::binmax (int k)
+{
+    // Upper limit of bin 'k' in ns.
+    if (k < 4) return k + 1;
+    return ldexp (5 + (k & 3), k / 4 - 1);
+}
+
+
+void Dsptimer::endcycle (uint64_t t0)
+{
+    int       i, j;
+    uint32_t  n, t;
+
+    _acc [ST_TOTAL] = now () - t0;
+    n = _ncycle.load (std::memory_order_relaxed);
+    j = n % NRING;
+    for (i = 0; i < NSTAGE; i++)
+    {
+        t = (_acc [i] > 0xFFFFFFFF) ? 0xFFFFFFFF : _acc [i];
+        _acc [i] = 0;
+        // Single writer, so load and store are enough.
+        _hist [i][bin (t)].store (_hist [i][bin (t)].load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        _sum [i].store (_sum [i].load (std::memory_order_relaxed) + t, std::memory_order_relaxed);
+        if (t > _max [i].load (std::memory_order_relaxed)) _max [i].store (t, std::memory_order_relaxed);
+        _ring [j][i].store (t, std::memory_order_relaxed);
+    }
+    _ncycle.store (n + 1, std::memory_order_release);
+}
+
+
+void Dsptimer::xrun (void)
+{
+    int       i, j, k, m;
+    uint32_t  n, t, w;
+    Xrun      *X;
+
+    // Find the slowest recent cycle.
+    n = _ncycle.load (std::memory_order_acquire);
+    m = (n < NRING) ? n : NRING;
+    w = 0;
+    k = 0;
+    for (i = 1; i <= m; i++)
+    {
+        j = (n - i) % NRING;
+        t = _ring [j][ST_TOTAL].load (std::memory_order_relaxed);
+        if (t > w)
+        {
+            w = t;
+            k = j;
+        }
+    }
+    X = _xruns + _nxrun.load (std::memory_order_relaxed) % NXRUN;
+    X->_time = now ();
+    X->_cycle = n;
+    for (i = 0; i < NSTAGE; i++) X->_stage [i] = _ring [k][i].load (std::memory_order_relaxed);
+    _nxrun.fetch_add (1, std::memory_order_release);
+}
+
+
+void Dsptimer::stats (int stage, Stats *S) const
+{
+    int       k;
+    uint32_t  h [NBIN], n, c;
+
+    // Copy the histogram first, it may change while we read it.
+    for (k = 0, n = 0; k < NBIN; k++)
+    {
+        h [k] = _hist [stage][k].load (std::memory_order_relaxed);
+        n += h [k];
+    }
+    S->_count = n;
+    S->_mean = n ? (double) _sum [stage].load (std::memory_order_relaxed) / n : 0;
+    S->_max = _max [stage].load (std::memory_order_relaxed);
+    S->_p50 = S->_p99 = S->_p999 = 0;
+    for (k = 0, c = 0; k < NBIN; k++)
+    {
+        c += h [k];
+        if (! S->_p50  && (c >= 0.500 * n)) S->_p50  = binmax (k);
+        if (! S->_p99  && (c >= 0.990 * n)) S->_p99  = binmax (k);
+        if (! S->_p999 && (c >= 0.999 * n)) S->_p999 = binmax (k);
+    }
+}
+
+
+void Dsptimer::get_xrun (int k, Xrun *X) const
+{
+    // Records are overwritten after NXRUN more xruns.
+    *X = _xruns [k % NXRUN];
+}
+
+
+void Dsptimer::report (FILE *F, double tper) const
+{
+    int       i, k, n;
+    Stats     S;
+    Xrun      X;
+
+    fprintf (F, "%u cycles, %u xruns, period %.2lf ms\n", ncycle (), nxrun (), 1e3 * tper);
+    fprintf (F, "stage         mean      p50      p99    p99.9      max   (us)\n");
+    for (i = 0; i < NSTAGE; i++)
+    {
+        stats (i, &S);
+        fprintf (F, "%-10s %8.1lf %8.1lf %8.1lf %8.1lf %8.1lf\n", stage_name (i),
+                 1e-3 * S._mean, 1e-3 * S._p50, 1e-3 * S._p99, 1e-3 * S._p999, 1e-3 * S._max);
+    }
+    n = nxrun ();
+    k = (n > NXRUN) ? n - NXRUN : 0;
+    for (; k < n; k++)
+    {
+        get_xrun (k, &X);
+        fprintf (F, "xrun %3d at cycle %u, slowest recent cycle %.1lf us (%.0lf%% of period):",
+                 k + 1, X._cycle, 1e-3 * X._stage [ST_TOTAL], 1e-7 * X._stage [ST_TOTAL] / tper);
+        for (i = 0; i < ST_TOTAL; i++) fprintf (F, " %s %.1lf", stage_name (i), 1e-3 * X._stage [i]);
+        fprintf (F, "\n");
+    }
+}
@@ -0,0 +1,122 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2009-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+
+#ifndef __DSPTIMER_H
+#define __DSPTIMER_H
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+
+
+// Timing of the processing stages. The process thread adds the time
+// of each stage in the current cycle using lap(), and calls endcycle()
+// at the end. All counters are atomic and have a single writer, so
+// the statistics can be read at any time from any thread. Histogram
+// bins are a quarter octave wide, so percentiles are upper bounds
+// within 19%.
+//
+// xrun() should be called from the JACK xrun callback. It records
+// the stage times of the slowest of the most recent NRING cycles,
+// which will normally include the one that was late.
+
+
+class Dsptimer
+{
+public:
+
+    // Events and masks, input resampling, interpolation, pitch estimation,
+    // and the pitch and dry outputs. The total includes all of these.
+    enum { ST_MIDI, ST_RESAMP, ST_INTERP, ST_ESTIM, ST_OUTPUT, ST_TOTAL, NSTAGE };
+    enum { NBIN = 128, NRING = 64, NXRUN = 16 };
+
+    class Stats
+    {
+    public:
+
+        uint32_t  _count;
+        double    _mean;
+        double    _max;
+        double    _p50;
+        double    _p99;
+        double    _p999;
+    };
+
+    class Xrun
+    {
+    public:
+
+        uint64_t  _time;
+        uint32_t  _cycle;
+        uint32_t  _stage [NSTAGE];
+    };
+
+    Dsptimer (void);
+
+    static const char *stage_name (int stage);
+
+    static uint64_t now (void)
+    {
+        struct timespec t;
+
+        clock_gettime (CLOCK_MONOTONIC, &t);
+        return t.tv_sec * (uint64_t) 1000000000 + t.tv_nsec;
+    }
+
+    // Process thread only.
+    uint64_t lap (int stage, uint64_t t)
+    {
+        uint64_t n = now ();
+        _acc [stage] += n - t;
+        return n;
+    }
+    void endcycle (uint64_t t0);
+
+    // Any thread.
+    void xrun (void);
+    uint32_t ncycle (void) const { return _ncycle.load (std::memory_order_relaxed); }
+    uint32_t nxrun (void) const { return _nxrun.load (std::memory_order_relaxed); }
+    void stats (int stage, Stats *S) const;
+    void get_xrun (int k, Xrun *X) const;
+
+    // Print all statistics, relative to a period of 'tper' seconds.
+    void report (FILE *F, double tper) const;
+
+private:
+
+    static int bin (uint32_t ns);
+    static double binmax (int k);
+
+    uint64_t                _acc [NSTAGE];
+    std::atomic<uint32_t>   _ncycle;
+    std::atomic<uint32_t>   _nxrun;
+    std::atomic<uint32_t>   _hist [NSTAGE][NBIN];
+    std::atomic<uint64_t>   _sum [NSTAGE];
+    std::atomic<uint32_t>   _max [NSTAGE];
+    std::atomic<uint32_t>   _ring [NRING][NSTAGE];
+    Xrun                    _xruns [NXRUN];
+};
+
+
+#endif
@@ -0,0 +1,306 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2010 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "headless.h"
+#include "global.h"
+#include "nsm.h"
+
+
+extern NSM_Client *nsm;
+
+
+Headless::Headless (Jclient *jclient, const char *ctlpath) :
+    _jclient (jclient),
+    _stop (false),
+    _dirty (false),
+    _xp (100),
+    _yp (100),
+    _lsock (-1)
+{
+    int i;
+
+    for (i = 0; i < NCTLPAR; i++) apply (i, ctlparams [i].vdef);
+    for (i = 0; i < MAXCONN; i++) _conn [i]._fd = -1;
+    if (ctlpath) open_socket (ctlpath);
+}
+
+
+Headless::~Headless (void)
+{
+    int i;
+
+    for (i = 0; i < MAXCONN; i++) close_conn (_conn + i);
+    if (_lsock >= 0)
+    {
+        close (_lsock);
+        unlink (_ctlpath.c_str ());
+    }
+}
+
+
+void Headless::apply (int k, float v)
+{
+    switch (k)
+    {
+    case CTL_TUNE:  _jclient->set_refpitch (v); break;
+    case CTL_BIAS:  _jclient->set_notebias (v); break;
+    case CTL_FILT:  _jclient->set_corrfilt (v); break;
+    case CTL_CORR:  _jclient->set_corrgain (v); break;
+    case CTL_OFFS:  _jclient->set_corroffs (v); break;
+    case CTL_NOTES: _jclient->set_notemask ((int) v); break;
+    }
+}
+
+
+bool Headless::set_param (const char *name, const char *value)
+{
+    int    k;
+    float  v;
+    char   *q;
+
+    for (k = 0; k < NCTLPAR; k++)
+    {
+        if (! strcmp (name, ctlparams [k].name)) break;
+    }
+    if (k == NCTLPAR) return false;
+    if (k == CTL_NOTES) v = strtol (value, &q, 16);
+    else v = strtof (value, &q);
+    if ((q == value) || (*q && (*q != '\n'))) return false;
+    if (v < ctlparams [k].vmin) v = ctlparams [k].vmin;
+    if (v > ctlparams [k].vmax) v = ctlparams [k].vmax;
+    apply (k, v);
+    return true;
+}
+
+
+int Headless::format (char *s, int n)
+{
+    int i, k;
+
+    // The format used by Mainwin::save_state ().
+    for (i = k = 0; i < CTL_NOTES; i++)
+    {
+        k += snprintf (s + k, n - k, "%s\t%g\n", ctlparams [i].name, _jclient->get_param (i));
+    }
+    k += snprintf (s + k, n - k, "%s\t%x\n", ctlparams [CTL_NOTES].name, (int) _jclient->get_param (CTL_NOTES));
+    return k;
+}
+
+
+void Headless::load_state (void)
+{
+    FILE  *F;
+    char  name [64], value [64];
+
+    if (_statefile.empty () || ! (F = fopen (_statefile.c_str (), "r"))) return;
+    while (fscanf (F, "%63s %63s", name, value) == 2)
+    {
+        if      (! strcmp (name, "/window/x")) _xp = atoi (value);
+        else if (! strcmp (name, "/window/y")) _yp = atoi (value);
+        else set_param (name, value);
+    }
+    fclose (F);
+}
+
+
+void Headless::save_state (void)
+{
+    FILE  *F;
+    char  s [512];
+
+    if (_statefile.empty () || ! (F = fopen (_statefile.c_str (), "w"))) return;
+    format (s, sizeof (s));
+    fputs (s, F);
+    // Keep the window position for the GUI.
+    fprintf (F, "/window/x\t%d\n/window/y\t%d\n", _xp, _yp);
+    fclose (F);
+    _dirty = false;
+    if (nsm) nsm->is_clean ();
+}
+
+
+void Headless::open_socket (const char *path)
+{
+    struct sockaddr_un  addr;
+
+    if (strlen (path) >= sizeof (addr.sun_path))
+    {
+        fprintf (stderr, "Control socket path too long.\n");
+        return;
+    }
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, path);
+    unlink (path);
+    _lsock = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (   (_lsock < 0)
+        || bind (_lsock, (struct sockaddr *) &addr, sizeof (addr))
+        || listen (_lsock, MAXCONN))
+    {
+        fprintf (stderr, "Can't create control socket '%s': %s.\n", path, strerror (errno));
+        if (_lsock >= 0) close (_lsock);
+        _lsock = -1;
+        return;
+    }
+    _ctlpath = path;
+}
+
+
+void Headless::close_conn (Conn *C)
+{
+    if (C->_fd < 0) return;
+    close (C->_fd);
+    C->_fd = -1;
+}
+
+
+void Headless::handle_conn (Conn *C)
+{
+    int   n;
+    char  *p, *q;
+
+    n = read (C->_fd, C->_line + C->_len, LINELEN - 1 - C->_len);
+    if (n <= 0)
+    {
+        if ((n < 0) && (errno == EAGAIN || errno == EINTR)) return;
+        close_conn (C);
+        return;
+    }
+    C->_len += n;
+    C->_line [C->_len] = 0;
+
+    // Execute all complete lines, keep the rest.
+    p = C->_line;
+    while ((q = strchr (p, '\n')))
+    {
+        *q = 0;
+        command (C, p);
+        if (C->_fd < 0) return;
+        p = q + 1;
+    }
+    C->_len -= p - C->_line;
+    memmove (C->_line, p, C->_len);
+    if (C->_len == LINELEN - 1)
+    {
+        // Line too long.
+        close_conn (C);
+    }
+}
+
+
+void Headless::command (Conn *C, char *line)
+{
+    char  name [64], value [64], s [512];
+    int   n;
+
+    n = sscanf (line, "%63s %63s", name, value);
+    if (n <= 0) return;
+    if ((n == 1) && ! strcmp (name, "get"))
+    {
+        n = format (s, sizeof (s) - 3);
+        strcpy (s + n, "ok\n");
+    }
+    else if ((n == 1) && ! strcmp (name, "save") && ! _statefile.empty ())
+    {
+        save_state ();
+        strcpy (s, "ok\n");
+    }
+    else if ((n == 2) && set_param (name, value))
+    {
+        if (! _dirty)
+        {
+            if (nsm) nsm->is_dirty ();
+            _dirty = true;
+        }
+        strcpy (s, "ok\n");
+    }
+    else strcpy (s, "error\n");
+    // Replies are short, a client that doesn't read them is dropped.
+    // No SIGPIPE if it has already gone away.
+    if (send (C->_fd, s, strlen (s), MSG_NOSIGNAL) != (ssize_t) strlen (s)) close_conn (C);
+}
+
+
+int Headless::process (void)
+{
+    int            i, n, fd;
+    struct pollfd  P [MAXCONN + 2];
+    Conn           *C;
+
+    if (_stop || _jclient->shutdown ()) return EV_EXIT;
+
+    // The timeout is only for signals handled by another thread
+    // and JACK shutdown. NSM messages are read by the caller, so
+    // just return when there is one.
+    n = 0;
+    if (nsm)
+    {
+        P [n].fd = nsm->fd ();
+        P [n++].events = POLLIN;
+    }
+    if (_lsock >= 0)
+    {
+        P [n].fd = _lsock;
+        P [n++].events = POLLIN;
+    }
+    for (i = 0; i < MAXCONN; i++)
+    {
+        if (_conn [i]._fd >= 0)
+        {
+            P [n].fd = _conn [i]._fd;
+            P [n++].events = POLLIN;
+        }
+    }
+    if (poll (P, n, 100) <= 0) return 0;
+    for (i = nsm ? 1 : 0; i < n; i++)
+    {
+        if (! P [i].revents) continue;
+        if (P [i].fd == _lsock)
+        {
+            fd = accept4 (_lsock, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) continue;
+            for (C = _conn; (C < _conn + MAXCONN) && (C->_fd >= 0); C++);
+            if (C == _conn + MAXCONN)
+            {
+                close (fd);
+                continue;
+            }
+            C->_fd = fd;
+            C->_len = 0;
+        }
+        else
+        {
+            for (C = _conn; C->_fd != P [i].fd; C++);
+            handle_conn (C);
+        }
+    }
+    return 0;
+}
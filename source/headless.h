@@ -0,0 +1,93 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2010 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+
+#ifndef __HEADLESS_H
+#define __HEADLESS_H
+
+
+#include <string>
+#include "jclient.h"
+#include "ctlparams.h"
+
+
+// Runs zita-at1 without a display. The parameters that are otherwise
+// set in the main window can be loaded from and saved to a state file
+// in the same format. The saved values are the current ones, which
+// may also have been set by OSC. They can also be changed by lines
+// of the same format sent to a local control socket, e.g.
+//
+//   /autotune/tune 442
+//   /autotune/notes 0xAB5
+//
+// and in addition 'get' returns all current values, 'save' writes
+// the state file. Every line is answered by 'ok' or 'error'.
+
+class Headless
+{
+public:
+
+    Headless (Jclient *jclient, const char *ctlpath);
+    ~Headless (void);
+
+    // Waits for control or NSM input for at most 0.1 seconds. Returns
+    // EV_EXIT after stop() is called or when JACK shuts down.
+    int  process (void);
+    void stop (void) { _stop = true; }
+
+    void set_statefile (const std::string &statefile) { _statefile = statefile; }
+    void load_state (void);
+    void save_state (void);
+
+private:
+
+    enum { MAXCONN = 4, LINELEN = 256 };
+
+    class Conn
+    {
+    public:
+
+        int     _fd;
+        int     _len;
+        char    _line [LINELEN];
+    };
+
+    bool set_param (const char *name, const char *value);
+    void apply (int k, float v);
+    int  format (char *s, int n);
+    void open_socket (const char *path);
+    void close_conn (Conn *C);
+    void handle_conn (Conn *C);
+    void command (Conn *C, char *line);
+
+    Jclient        *_jclient;
+    volatile bool   _stop;
+    bool            _dirty;
+    int             _xp;
+    int             _yp;
+    std::string     _statefile;
+    std::string     _ctlpath;
+    int             _lsock;
+    Conn            _conn [MAXCONN];
+};
+
+
+#endif
@@ -0,0 +1,451 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2009-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+#include "interp.h"
+#if defined(__x86_64__) || defined(__i386__)
+#define INTERP_X86
+#include <immintrin.h>
+#endif
+
+
+static void cubic_scalar (const float *buff, int size, float *r, float dr,
+                          float *out, int n)
+{
+    int    i;
+    float  r1;
+
+    r1 = *r;
+    while (n--)
+    {
+        i = (int) r1;
+        *out++ = cubic (buff + i, r1 - i);
+        r1 += dr;
+        if (r1 >= size) r1 -= size;
+    }
+    *r = r1;
+}
+
+
+static void xfade_scalar (const float *buff, int size, float *r1, float *r2, float dr,
+                          const float *xf, float *out, int n)
+{
+    int    i;
+    float  a1, a2, u1, u2, v;
+
+    a1 = *r1;
+    a2 = *r2;
+    while (n--)
+    {
+        i = (int) a1;
+        u1 = cubic (buff + i, a1 - i);
+        i = (int) a2;
+        u2 = cubic (buff + i, a2 - i);
+        v = *xf++;
+        *out++ = (1 - v) * u1 + v * u2;
+        a1 += dr;
+        if (a1 >= size) a1 -= size;
+        a2 += dr;
+        if (a2 >= size) a2 -= size;
+    }
+    *r1 = a1;
+    *r2 = a2;
+}
+
+
+#ifdef INTERP_X86
+
+
+// The vector versions interpolate W samples at once. The read positions
+// are still advanced one sample at a time, exactly as in the scalar code.
+// Computing them as r + j * dr would be faster, but the small rounding
+// differences accumulate and eventually change the jump decisions made
+// in Retuner::process(). Any samples left over are done by the scalar
+// code.
+//
+// The buffer size is not made a compile time constant for each sample
+// rate. The wrap is a float compare and subtract, not a modulo, and a
+// fixed size made no measurable difference.
+
+
+static inline void advance (float *p, float &a, float dr, int size, int n)
+{
+    int    j;
+    float  b;
+
+    // The position can wrap at most once per call. Testing for it
+    // in advance keeps the compare out of the loop in most cases.
+    // The estimate can be wrong by the rounding of the sums, so if
+    // the end position does need a wrap the loop is done again.
+    if (a + (n + 1) * dr < size)
+    {
+        b = a;
+        for (j = 0; j < n; j++)
+        {
+            p [j] = a;
+            a += dr;
+        }
+        if (a < size) return;
+        a = b;
+    }
+    for (j = 0; j < n; j++)
+    {
+        p [j] = a;
+        a += dr;
+        if (a >= size) a -= size;
+    }
+}
+
+
+// SSE2 has no gather. Four unaligned loads followed by a transpose
+// give the four taps of four read positions.
+
+__attribute__ ((target ("sse2")))
+static inline __m128 cubic_sse2 (const float *buff, __m128 r)
+{
+    __m128i  i;
+    __m128   a, b, c, x0, x1, x2, x3;
+    int      k [4];
+
+    i = _mm_cvttps_epi32 (r);
+    a = _mm_sub_ps (r, _mm_cvtepi32_ps (i));
+    _mm_storeu_si128 ((__m128i *) k, i);
+    x0 = _mm_loadu_ps (buff + k [0]);
+    x1 = _mm_loadu_ps (buff + k [1]);
+    x2 = _mm_loadu_ps (buff + k [2]);
+    x3 = _mm_loadu_ps (buff + k [3]);
+    _MM_TRANSPOSE4_PS (x0, x1, x2, x3);
+    b = _mm_sub_ps (_mm_set1_ps (1.0f), a);
+    c = _mm_mul_ps (a, b);
+    x1 = _mm_add_ps (x1, x2);
+    x2 = _mm_add_ps (_mm_mul_ps (x2, a), _mm_mul_ps (_mm_sub_ps (x1, x2), b));
+    x0 = _mm_add_ps (_mm_add_ps (_mm_mul_ps (x0, b), x1), _mm_mul_ps (x3, a));
+    return _mm_sub_ps (_mm_mul_ps (_mm_add_ps (_mm_set1_ps (1.0f), _mm_mul_ps (_mm_set1_ps (1.5f), c)), x2),
+                       _mm_mul_ps (_mm_mul_ps (_mm_set1_ps (0.5f), c), x0));
+}
+
+
+__attribute__ ((target ("sse2")))
+static void cubic_sse2 (const float *buff, int size, float *r, float dr,
+                        float *out, int n)
+{
+    float  a;
+    float  p [4] __attribute__ ((aligned (16)));
+
+    a = *r;
+    while (n >= 4)
+    {
+        advance (p, a, dr, size, 4);
+        _mm_storeu_ps (out, cubic_sse2 (buff, _mm_load_ps (p)));
+        out += 4;
+        n -= 4;
+    }
+    *r = a;
+    if (n) cubic_scalar (buff, size, r, dr, out, n);
+}
+
+
+__attribute__ ((target ("sse2")))
+static void xfade_sse2 (const float *buff, int size, float *r1, float *r2, float dr,
+                        const float *xf, float *out, int n)
+{
+    __m128  u1, u2, v;
+    float   a1, a2;
+    float   p1 [4] __attribute__ ((aligned (16)));
+    float   p2 [4] __attribute__ ((aligned (16)));
+
+    a1 = *r1;
+    a2 = *r2;
+    while (n >= 4)
+    {
+        advance (p1, a1, dr, size, 4);
+        advance (p2, a2, dr, size, 4);
+        u1 = cubic_sse2 (buff, _mm_load_ps (p1));
+        u2 = cubic_sse2 (buff, _mm_load_ps (p2));
+        v = _mm_loadu_ps (xf);
+        _mm_storeu_ps (out, _mm_add_ps (u1, _mm_mul_ps (v, _mm_sub_ps (u2, u1))));
+        xf += 4;
+        out += 4;
+        n -= 4;
+    }
+    *r1 = a1;
+    *r2 = a2;
+    if (n) xfade_scalar (buff, size, r1, r2, dr, xf, out, n);
+}
+
+
+// AVX2 and AVX-512 do have gathers, but on many CPUs they are slower
+// than the unaligned loads and transposes used here. The transposes
+// work within each 128-bit lane, so the position of each load in
+// the vectors is chosen to make the result come out in order.
+
+__attribute__ ((target ("avx2,fma")))
+static inline __m256 cubic_avx2 (const float *buff, __m256 r)
+{
+    __m256i  i;
+    __m256   a, b, c, t0, t1, t2, t3, x0, x1, x2, x3;
+    int      k [8] __attribute__ ((aligned (32)));
+
+    i = _mm256_cvttps_epi32 (r);
+    a = _mm256_sub_ps (r, _mm256_cvtepi32_ps (i));
+    _mm256_store_si256 ((__m256i *) k, i);
+    x0 = _mm256_insertf128_ps (_mm256_castps128_ps256 (_mm_loadu_ps (buff + k [0])), _mm_loadu_ps (buff + k [4]), 1);
+    x1 = _mm256_insertf128_ps (_mm256_castps128_ps256 (_mm_loadu_ps (buff + k [1])), _mm_loadu_ps (buff + k [5]), 1);
+    x2 = _mm256_insertf128_ps (_mm256_castps128_ps256 (_mm_loadu_ps (buff + k [2])), _mm_loadu_ps (buff + k [6]), 1);
+    x3 = _mm256_insertf128_ps (_mm256_castps128_ps256 (_mm_loadu_ps (buff + k [3])), _mm_loadu_ps (buff + k [7]), 1);
+    t0 = _mm256_unpacklo_ps (x0, x1);
+    t1 = _mm256_unpacklo_ps (x2, x3);
+    t2 = _mm256_unpackhi_ps (x0, x1);
+    t3 = _mm256_unpackhi_ps (x2, x3);
+    x0 = _mm256_shuffle_ps (t0, t1, 0x44);
+    x1 = _mm256_shuffle_ps (t0, t1, 0xEE);
+    x2 = _mm256_shuffle_ps (t2, t3, 0x44);
+    x3 = _mm256_shuffle_ps (t2, t3, 0xEE);
+    b = _mm256_sub_ps (_mm256_set1_ps (1.0f), a);
+    c = _mm256_mul_ps (a, b);
+    x1 = _mm256_add_ps (x1, x2);
+    x2 = _mm256_fmadd_ps (x2, a, _mm256_mul_ps (_mm256_sub_ps (x1, x2), b));
+    x0 = _mm256_fmadd_ps (x3, a, _mm256_fmadd_ps (x0, b, x1));
+    return _mm256_fmsub_ps (_mm256_fmadd_ps (_mm256_set1_ps (1.5f), c, _mm256_set1_ps (1.0f)), x2,
+                            _mm256_mul_ps (_mm256_mul_ps (_mm256_set1_ps (0.5f), c), x0));
+}
+
+
+__attribute__ ((target ("avx2,fma")))
+static void cubic_avx2 (const float *buff, int size, float *r, float dr,
+                        float *out, int n)
+{
+    float  a;
+    float  p [8] __attribute__ ((aligned (32)));
+
+    a = *r;
+    while (n >= 8)
+    {
+        advance (p, a, dr, size, 8);
+        _mm256_storeu_ps (out, cubic_avx2 (buff, _mm256_load_ps (p)));
+        out += 8;
+        n -= 8;
+    }
+    *r = a;
+    if (n) cubic_scalar (buff, size, r, dr, out, n);
+}
+
+
+__attribute__ ((target ("avx2,fma")))
+static void xfade_avx2 (const float *buff, int size, float *r1, float *r2, float dr,
+                        const float *xf, float *out, int n)
+{
+    __m256  u1, u2, v;
+    float   a1, a2;
+    float   p1 [8] __attribute__ ((aligned (32)));
+    float   p2 [8] __attribute__ ((aligned (32)));
+
+    a1 = *r1;
+    a2 = *r2;
+    while (n >= 8)
+    {
+        advance (p1, a1, dr, size, 8);
+        advance (p2, a2, dr, size, 8);
+        u1 = cubic_avx2 (buff, _mm256_load_ps (p1));
+        u2 = cubic_avx2 (buff, _mm256_load_ps (p2));
+        v = _mm256_loadu_ps (xf);
+        _mm256_storeu_ps (out, _mm256_fmadd_ps (v, _mm256_sub_ps (u2, u1), u1));
+        xf += 8;
+        out += 8;
+        n -= 8;
+    }
+    *r1 = a1;
+    *r2 = a2;
+    if (n) xfade_scalar (buff, size, r1, r2, dr, xf, out, n);
+}
+
+
+// Some versions of gcc give false 'uninitialized' warnings
+// from inside the AVX-512 intrinsics.
+#pragma GCC diagnostic ignored "-Wuninitialized"
+
+__attribute__ ((target ("avx512f")))
+static inline __m512 load4_avx512 (const float *buff, const int *k)
+{
+    __m512  x;
+
+    x = _mm512_castps128_ps512 (_mm_loadu_ps (buff + k [0]));
+    x = _mm512_insertf32x4 (x, _mm_loadu_ps (buff + k [4]), 1);
+    x = _mm512_insertf32x4 (x, _mm_loadu_ps (buff + k [8]), 2);
+    return _mm512_insertf32x4 (x, _mm_loadu_ps (buff + k [12]), 3);
+}
+
+
+__attribute__ ((target ("avx512f")))
+static inline __m512 cubic_avx512 (const float *buff, __m512 r)
+{
+    __m512i  i;
+    __m512   a, b, c, t0, t1, t2, t3, x0, x1, x2, x3;
+    int      k [16] __attribute__ ((aligned (64)));
+
+    i = _mm512_cvttps_epi32 (r);
+    a = _mm512_sub_ps (r, _mm512_cvtepi32_ps (i));
+    _mm512_store_si512 (k, i);
+    x0 = load4_avx512 (buff, k + 0);
+    x1 = load4_avx512 (buff, k + 1);
+    x2 = load4_avx512 (buff, k + 2);
+    x3 = load4_avx512 (buff, k + 3);
+    t0 = _mm512_unpacklo_ps (x0, x1);
+    t1 = _mm512_unpacklo_ps (x2, x3);
+    t2 = _mm512_unpackhi_ps (x0, x1);
+    t3 = _mm512_unpackhi_ps (x2, x3);
+    x0 = _mm512_shuffle_ps (t0, t1, 0x44);
+    x1 = _mm512_shuffle_ps (t0, t1, 0xEE);
+    x2 = _mm512_shuffle_ps (t2, t3, 0x44);
+    x3 = _mm512_shuffle_ps (t2, t3, 0xEE);
+    b = _mm512_sub_ps (_mm512_set1_ps (1.0f), a);
+    c = _mm512_mul_ps (a, b);
+    x1 = _mm512_add_ps (x1, x2);
+    x2 = _mm512_fmadd_ps (x2, a, _mm512_mul_ps (_mm512_sub_ps (x1, x2), b));
+    x0 = _mm512_fmadd_ps (x3, a, _mm512_fmadd_ps (x0, b, x1));
+    return _mm512_fmsub_ps (_mm512_fmadd_ps (_mm512_set1_ps (1.5f), c, _mm512_set1_ps (1.0f)), x2,
+                            _mm512_mul_ps (_mm512_mul_ps (_mm512_set1_ps (0.5f), c), x0));
+}
+
+
+__attribute__ ((target ("avx512f")))
+static void cubic_avx512 (const float *buff, int size, float *r, float dr,
+                        float *out, int n)
+{
+    float  a;
+    float  p [16] __attribute__ ((aligned (64)));
+
+    a = *r;
+    while (n >= 16)
+    {
+        advance (p, a, dr, size, 16);
+        _mm512_storeu_ps (out, cubic_avx512 (buff, _mm512_load_ps (p)));
+        out += 16;
+        n -= 16;
+    }
+    *r = a;
+    if (n) cubic_scalar (buff, size, r, dr, out, n);
+}
+
+
+__attribute__ ((target ("avx512f")))
+static void xfade_avx512 (const float *buff, int size, float *r1, float *r2, float dr,
+                        const float *xf, float *out, int n)
+{
+    __m512  u1, u2, v;
+    float   a1, a2;
+    float   p1 [16] __attribute__ ((aligned (64)));
+    float   p2 [16] __attribute__ ((aligned (64)));
+
+    a1 = *r1;
+    a2 = *r2;
+    while (n >= 16)
+    {
+        advance (p1, a1, dr, size, 16);
+        advance (p2, a2, dr, size, 16);
+        u1 = cubic_avx512 (buff, _mm512_load_ps (p1));
+        u2 = cubic_avx512 (buff, _mm512_load_ps (p2));
+        v = _mm512_loadu_ps (xf);
+        _mm512_storeu_ps (out, _mm512_fmadd_ps (v, _mm512_sub_ps (u2, u1), u1));
+        xf += 16;
+        out += 16;
+        n -= 16;
+    }
+    *r1 = a1;
+    *r2 = a2;
+    if (n) xfade_scalar (buff, size, r1, r2, dr, xf, out, n);
+}
+
+
+#endif
+
+
+Interp_func  interp_cubic = cubic_scalar;
+Xfade_func   interp_xfade = xfade_scalar;
+
+static int interp_level = INTERP_AUTO;
+
+
+static bool supported (int level)
+{
+#ifdef INTERP_X86
+    __builtin_cpu_init ();
+    switch (level)
+    {
+    case INTERP_SCALAR: return true;
+    case INTERP_SSE2:   return __builtin_cpu_supports ("sse2");
+    case INTERP_AVX2:   return __builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma");
+    case INTERP_AVX512: return __builtin_cpu_supports ("avx512f");
+    }
+    return false;
+#else
+    return level == INTERP_SCALAR;
+#endif
+}
+
+
+int interp_init (int level)
+{
+    // The AVX-512 code is not faster than the AVX2 one, as the loop
+    // is limited by the read position updates. Since wide vectors
+    // may reduce the clock rate on some CPUs, AVX2 is preferred.
+    static const int order [INTERP_NLEVEL] = { INTERP_AVX2, INTERP_AVX512, INTERP_SSE2, INTERP_SCALAR };
+    int i;
+
+    if (level == INTERP_AUTO)
+    {
+        if (interp_level != INTERP_AUTO) return interp_level;
+        for (i = 0; ! supported (order [i]); i++);
+        level = order [i];
+    }
+    else if ((level < 0) || (level >= INTERP_NLEVEL) || ! supported (level)) return -1;
+
+    switch (level)
+    {
+#ifdef INTERP_X86
+    case INTERP_SSE2:
+        interp_cubic = cubic_sse2;
+        interp_xfade = xfade_sse2;
+        break;
+    case INTERP_AVX2:
+        interp_cubic = cubic_avx2;
+        interp_xfade = xfade_avx2;
+        break;
+    case INTERP_AVX512:
+        interp_cubic = cubic_avx512;
+        interp_xfade = xfade_avx512;
+        break;
+#endif
+    default:
+        interp_cubic = cubic_scalar;
+        interp_xfade = xfade_scalar;
+    }
+    interp_level = level;
+    return level;
+}
+
+
+const char *interp_name (int level)
+{
+    static const char *names [INTERP_NLEVEL] = { "scalar", "sse2", "avx2", "avx512" };
+
+    if ((level < 0) || (level >= INTERP_NLEVEL)) return 0;
+    return names [level];
+}
@@ -0,0 +1,72 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2009-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+#ifndef __INTERP_H
+#define __INTERP_H
+
+
+// Cubic interpolation from a circular buffer of 'size' samples,
+// followed by three copies of the first ones. The read position
+// '*r' advances by 'dr' per output sample, and is updated.
+// The crossfade version reads at '*r1' and '*r2' and mixes the
+// two using the gains in 'xf'. All versions produce the same
+// result as the scalar one within float rounding.
+
+typedef void (*Interp_func) (const float *buff, int size, float *r, float dr,
+                             float *out, int n);
+typedef void (*Xfade_func)  (const float *buff, int size, float *r1, float *r2, float dr,
+                             const float *xf, float *out, int n);
+
+
+enum
+{
+    INTERP_AUTO = -1,
+    INTERP_SCALAR,
+    INTERP_SSE2,
+    INTERP_AVX2,
+    INTERP_AVX512,
+    INTERP_NLEVEL
+};
+
+
+// Select the implementation. INTERP_AUTO takes the best one the
+// CPU supports, and does nothing if a selection was already made.
+// Returns the level actually used, or -1 if the requested one is
+// not supported.
+extern int interp_init (int level);
+extern const char *interp_name (int level);
+
+extern Interp_func  interp_cubic;
+extern Xfade_func   interp_xfade;
+
+
+inline float cubic (const float *v, float a)
+{
+    float b, c;
+
+    b = 1 - a;
+    c = a * b;
+    return (1.0f + 1.5f * c) * (v[1] * b + v[2] * a)
+            - 0.5f * c * (v[0] * b + v[1] + v[2] + v[3] * a);
+}
+
+
+#endif
@@ -17,36 +17,50 @@
 //  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 //
 // -----------------------------------------------------------------------
-
-
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include <jack/midiport.h>
 #include "jclient.h"
 #include "global.h"
 
 
-Jclient::Jclient (const char *jname, const char *jserv) :
+Jclient::Jclient (const char *jname, const char *jserv, int estim, int pdtype, int profile, int nvoice, int ports, int nchan) :
     A_thread ("jclient"),
     _jack_client (0),
     _active (false),
-    _jname (0)
+    _shutdown (false),
+    _jname (0),
+    _nchan (0),
+    _chan (0),
+    _latency (0),
+    _freewheel (false),
+    _nlost (0),
+    _noscev (0),
+    _newset (false)
 {
-    init_jack (jname, jserv);
+    int i;
+
+    for (i = 0; i < NCTLPAR; i++) _curpar [i] = ctlparams [i].vdef;
+    pthread_mutex_init (&_smutex, 0);
+    init_jack (jname, jserv, estim, pdtype, profile, nvoice, ports, nchan);
 }
 
 
 Jclient::~Jclient (void)
 {
     if (_jack_client) close_jack ();
+    pthread_mutex_destroy (&_smutex);
 }
 
 
-void Jclient::init_jack (const char *jname, const char *jserv)
+void Jclient::init_jack (const char *jname, const char *jserv, int estim, int pdtype, int profile, int nvoice, int ports, int nchan)
 {
     jack_status_t  stat;
-    int            opts;
+    int            c, i, opts;
+    char           s [16];
+    Channel        *C;
 
     opts = JackNoStartServer;
     if (jserv) opts |= JackServerName;
@@ -57,6 +71,11 @@ void Jclient::init_jack (const char *jname, const char *jserv)
     }
     jack_on_shutdown (_jack_client, jack_static_shutdown, (void *) this);
     jack_set_process_callback (_jack_client, jack_static_process, (void *) this);
+    jack_set_xrun_callback (_jack_client, jack_static_xrun, (void *) this);
+    jack_set_latency_callback (_jack_client, jack_static_latency, (void *) this);
+    jack_set_freewheel_callback (_jack_client, jack_static_freewheel, (void *) this);
+    jack_set_buffer_size_callback (_jack_client, jack_static_bufsize, (void *) this);
+    jack_set_sample_rate_callback (_jack_client, jack_static_srate, (void *) this);
     if (jack_activate (_jack_client))
     {
         fprintf(stderr, "Can't activate JACK.\n");
@@ -67,23 +86,225 @@ void Jclient::init_jack (const char *jname, const char *jserv)
     _fsamp = jack_get_sample_rate (_jack_client);
     _fsize = jack_get_buffer_size (_jack_client);
 
-    _ainp_port = jack_port_register (_jack_client, "in",  JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput,  0);
-    _aout_port = jack_port_register (_jack_client, "out", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
-    _midi_port = jack_port_register (_jack_client, "pitch", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
-
-    _retuner = new Retuner (_fsamp);
-    _notemask = 0xFFF;
+    if (nchan < 1) nchan = 1;
+    if (nchan > MAXCHAN) nchan = MAXCHAN;
+    if (nvoice > Retuner::MAXVOICE) nvoice = Retuner::MAXVOICE;
+    _nvoice = nvoice;
+    _estim = estim;
+    _pdtype = pdtype;
+    _profile = profile;
+    _chan = new Channel [nchan];
+    _nchan = nchan;
+    for (c = 0, C = _chan; c < _nchan; c++, C++)
+    {
+        C->_ainp_port = register_port ("in", c, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput);
+        C->_aout_port = register_port ("out", c, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput);
+        C->_midi_port = register_port ("pitch", c, JACK_DEFAULT_MIDI_TYPE, JackPortIsInput);
+        for (i = 0; i < _nvoice; i++)
+        {
+            sprintf (s, "voice%d", i + 1);
+            C->_voice_port [i] = register_port (s, c, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput);
+        }
+        C->_harm_port = 0;
+        if (_nvoice) C->_harm_port = register_port ("harmony", c, JACK_DEFAULT_MIDI_TYPE, JackPortIsInput);
+        C->_mout_port = register_port ("notes", c, JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput);
+        C->_cv_port = 0;
+        C->_dry_port = 0;
+        if (ports & PORT_CV) C->_cv_port = register_port ("cv", c, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput);
+        if (ports & PORT_DRY) C->_dry_port = register_port ("dry", c, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput);
+        memset (C->_harmkeys, 0, sizeof (C->_harmkeys));
+        C->_outnote = -1;
+        C->_outbend = 8192;
+        C->_cvvalue = 0;
+
+        C->_retuner = make_retuner (_fsamp, c);
+        C->_newret = 0;
+        C->_oldret = 0;
+        _latency = C->_retuner->latency ();
+        C->_drybuff = 0;
+        C->_newdry = 0;
+        if (C->_dry_port)
+        {
+            C->_drybuff = new float [_latency];
+            memset (C->_drybuff, 0, _latency * sizeof (float));
+            C->_dryindex = 0;
+        }
+        C->_notemask = 0xFFF;
+    }
     clr_midimask ();
 
+    _bstop = false;
+    _bfsamp = _fsamp;
+    sem_init (&_btrig, 0, 0);
+    sem_init (&_bdone, 0, 0);
+    if (pthread_create (&_bthread, 0, static_build, this))
+    {
+        fprintf (stderr, "Can't create thread.\n");
+        exit (1);
+    }
+
     _active = true;
+    jack_recompute_total_latencies (_jack_client);
+}
+
+
+jack_port_t *Jclient::register_port (const char *name, int c, const char *type, int flags)
+{
+    char s [32];
+
+    // With more than one channel add the channel number.
+    if (_nchan > 1)
+    {
+        snprintf (s, sizeof (s), "%s.%d", name, c + 1);
+        name = s;
+    }
+    return jack_port_register (_jack_client, name, type, flags, 0);
+}
+
+
+Retuner *Jclient::make_retuner (unsigned int fsamp, int c)
+{
+    int      prio;
+    Retuner  *R;
+
+    R = new Retuner (fsamp, _pdtype, _profile);
+    R->start_planner ();
+    R->set_timer (&_dsptimer);
+    // The telemetry ring has a single writer.
+    if (c == 0) R->set_telemetry (&_telemetry);
+    R->set_voices (_nvoice);
+    if (_estim == EST_SPREAD) R->set_spread (true);
+    if (_estim == EST_ASYNC)
+    {
+        // The pitch estimation thread must not preempt the
+        // JACK thread, so run it just below its priority.
+        // If JACK is not running realtime neither is the worker.
+        prio = jack_client_real_time_priority (_jack_client);
+        if (prio > 1) prio = R->start_worker (SCHED_FIFO, prio - 1);
+        else prio = -1;
+        if (prio && R->start_worker (SCHED_OTHER, 0))
+        {
+            fprintf (stderr, "Warning: can't start pitch estimation thread.\n");
+        }
+    }
+    return R;
+}
+
+
+void *Jclient::static_build (void *arg)
+{
+    ((Jclient *) arg)->build_main ();
+    return 0;
+}
+
+
+void Jclient::build_main (void)
+{
+    int           c;
+    unsigned int  fsamp;
+    Channel       *C;
+
+    while (true)
+    {
+        sem_wait (&_btrig);
+        if (_bstop) return;
+        fsamp = _bfsamp;
+        if (fsamp == _fsamp) continue;
+
+        // Everything that depends on the sample rate is made
+        // here: FFT plans, resamplers and buffers.
+        for (c = 0, C = _chan; c < _nchan; c++, C++)
+        {
+            C->_newret = make_retuner (fsamp, c);
+            _newlat = C->_newret->latency ();
+            if (C->_dry_port)
+            {
+                C->_newdry = new float [_newlat];
+                memset (C->_newdry, 0, _newlat * sizeof (float));
+            }
+        }
+
+        // No setter can run from here until the new Retuners
+        // are taken. This blocks them for at most one period.
+        pthread_mutex_lock (&_smutex);
+        for (c = 0, C = _chan; c < _nchan; c++, C++) C->_newret->copy_param (C->_retuner);
+        _newset.store (true, std::memory_order_release);
+
+        // Wait for the process thread to take them. It then leaves
+        // the old Retuners in '_oldret' and the old dry buffers in
+        // '_newdry'.
+        sem_wait (&_bdone);
+        pthread_mutex_unlock (&_smutex);
+        if (_newset.load (std::memory_order_acquire))
+        {
+            // Not taken, we are closing.
+            _newset.store (false, std::memory_order_relaxed);
+            for (c = 0, C = _chan; c < _nchan; c++, C++)
+            {
+                delete C->_newret;
+                C->_newret = 0;
+            }
+            return;
+        }
+        for (c = 0, C = _chan; c < _nchan; c++, C++)
+        {
+            delete C->_oldret;
+            C->_oldret = 0;
+            delete[] C->_newdry;
+            C->_newdry = 0;
+        }
+        _fsamp = fsamp;
+        jack_recompute_total_latencies (_jack_client);
+    }
+}
+
+
+void Jclient::take_retuners (void)
+{
+    int      c;
+    float    *d;
+    Channel  *C;
+
+    for (c = 0, C = _chan; c < _nchan; c++, C++)
+    {
+        // The values set by OSC are known only to this thread.
+        C->_newret->take_param (C->_retuner);
+        C->_oldret = C->_retuner;
+        C->_retuner = C->_newret;
+        C->_newret = 0;
+        d = C->_drybuff;
+        C->_drybuff = C->_newdry;
+        C->_newdry = d;
+        C->_dryindex = 0;
+    }
+    _latency = _newlat;
+    _newset.store (false, std::memory_order_release);
+    sem_post (&_bdone);
 }
 
 
 void Jclient::close_jack ()
 {
+    int      c;
+    Channel  *C;
+
     jack_deactivate (_jack_client);
+    _oscctl.stop ();
+    _bstop = true;
+    sem_post (&_btrig);
+    sem_post (&_bdone);
+    pthread_join (_bthread, 0);
+    sem_destroy (&_btrig);
+    sem_destroy (&_bdone);
     jack_client_close (_jack_client);
-    delete _retuner;
+    for (c = 0, C = _chan; c < _nchan; c++, C++)
+    {
+        delete C->_retuner;
+        delete C->_oldret;
+        delete[] C->_drybuff;
+        delete[] C->_newdry;
+    }
+    delete[] _chan;
 }
 
 
@@ -99,71 +320,479 @@ int Jclient::jack_static_process (jack_nframes_t nframes, void *arg)
 }
 
 
+int Jclient::jack_static_xrun (void *arg)
+{
+    return ((Jclient *) arg)->jack_xrun ();
+}
+
+
+void Jclient::jack_static_freewheel (int state, void *arg)
+{
+    ((Jclient *) arg)->jack_freewheel (state);
+}
+
+
+int Jclient::jack_static_bufsize (jack_nframes_t nframes, void *arg)
+{
+    return ((Jclient *) arg)->jack_bufsize (nframes);
+}
+
+
+int Jclient::jack_static_srate (jack_nframes_t fsamp, void *arg)
+{
+    return ((Jclient *) arg)->jack_srate (fsamp);
+}
+
+
+void Jclient::jack_static_latency (jack_latency_callback_mode_t mode, void *arg)
+{
+    ((Jclient *) arg)->jack_latency (mode);
+}
+
+
+void Jclient::report (FILE *F) const
+{
+    unsigned int n;
+
+    _dsptimer.report (F, (double) _fsize / _fsamp);
+    // Only while freewheeling with very long periods.
+    n = _nlost.load (std::memory_order_relaxed);
+    if (n) fprintf (F, "%u pitch estimates not sent\n", n);
+}
+
+
 void Jclient::jack_shutdown (void)
 {
+    _shutdown = true;
     send_event (EV_EXIT, 1);
 }
 
 
+int Jclient::jack_xrun (void)
+{
+    if (_active) _dsptimer.xrun ();
+    return 0;
+}
+
+
+void Jclient::jack_freewheel (int state)
+{
+    // Taken by the process thread at the start of the next cycle.
+    _freewheel = state;
+}
+
+
+int Jclient::jack_bufsize (int nframes)
+{
+    // The Retuner works in fragments that are independent of
+    // the period size, so there is nothing else to change.
+    _fsize = nframes;
+    return 0;
+}
+
+
+int Jclient::jack_srate (int fsamp)
+{
+    // Also called when the callback is set, before there
+    // is a Retuner. Other calls wake up the build thread.
+    if (! _active) return 0;
+    _bfsamp = fsamp;
+    sem_post (&_btrig);
+    return 0;
+}
+
+
+void Jclient::jack_latency (jack_latency_callback_mode_t mode)
+{
+    int                   c, i;
+    jack_latency_range_t  r;
+    Channel               *C;
+
+    // Can be called while init_jack() is still creating the
+    // ports. It recomputes the latencies when that is done.
+    if (! _active) return;
+
+    // All audio outputs are delayed by the Retuner latency. The
+    // MIDI and control outputs follow the input without delay.
+    for (c = 0, C = _chan; c < _nchan; c++, C++)
+    {
+        if (mode == JackCaptureLatency)
+        {
+            jack_port_get_latency_range (C->_ainp_port, mode, &r);
+            if (C->_mout_port) jack_port_set_latency_range (C->_mout_port, mode, &r);
+            if (C->_cv_port) jack_port_set_latency_range (C->_cv_port, mode, &r);
+            r.min += _latency;
+            r.max += _latency;
+            jack_port_set_latency_range (C->_aout_port, mode, &r);
+            if (C->_dry_port) jack_port_set_latency_range (C->_dry_port, mode, &r);
+            for (i = 0; i < _nvoice; i++) jack_port_set_latency_range (C->_voice_port [i], mode, &r);
+        }
+        else
+        {
+            jack_port_get_latency_range (C->_aout_port, mode, &r);
+            r.min += _latency;
+            r.max += _latency;
+            jack_port_set_latency_range (C->_ainp_port, mode, &r);
+        }
+    }
+}
+
+
+void Jclient::set_all (int k, void (Retuner::*f)(float), float v)
+{
+    int c;
+
+    pthread_mutex_lock (&_smutex);
+    _curpar [k].store (v, std::memory_order_relaxed);
+    for (c = 0; c < _nchan; c++) (_chan [c]._retuner->*f) (v);
+    pthread_mutex_unlock (&_smutex);
+}
+
+
+void Jclient::set_smoothing (float v)
+{
+    int c;
+
+    pthread_mutex_lock (&_smutex);
+    for (c = 0; c < _nchan; c++) _chan [c]._retuner->set_smoothing (v);
+    pthread_mutex_unlock (&_smutex);
+}
+
+
+void Jclient::set_interval (int v, float semit)
+{
+    int c;
+
+    if ((v < 0) || (v >= Retuner::MAXVOICE)) return;
+    pthread_mutex_lock (&_smutex);
+    for (c = 0; c < _nchan; c++) _chan [c]._retuner->set_interval (v, semit);
+    pthread_mutex_unlock (&_smutex);
+}
+
+
+void Jclient::set_notemask (int m)
+{
+    int c;
+
+    _curpar [CTL_NOTES].store (m, std::memory_order_relaxed);
+    for (c = 0; c < _nchan; c++) _chan [c]._notemask = m;
+}
+
+
 void Jclient::clr_midimask (void)
 {
-    int i;
+    int      c, i;
+    Channel  *C;
 
-    for (i = 0; i < 12; i++) _notes [i] = 0;
-    _midimask = 0; 
+    for (c = 0, C = _chan; c < _nchan; c++, C++)
+    {
+        for (i = 0; i < 12; i++) C->_notes [i] = 0;
+        C->_midimask = 0;
+    }
 }
 
 
-void Jclient::midi_process (int nframes)
+void Jclient::midi_event (Channel *C, jack_midi_event_t *E)
 {
-    int                i, b, n, t, v;
-    void               *p;
-    jack_midi_event_t  E;
+    int  n, t, v;
+
+    t = E->buffer [0];
+    n = E->buffer [1];
+    v = E->buffer [2];
+    switch (t & 0xF0)
+    {
+    case 0x80:
+    case 0x90:
+        if (v && (t & 0x10))
+        {
+            C->_notes [n % 12] += 1;
+        }
+        else
+        {
+            C->_notes [n % 12] -= 1;
+        }
+        break;
+    }
+}
 
-    p = jack_port_get_buffer (_midi_port, nframes);
-    i = 0;
-    while (jack_midi_event_get (&E, p, i) == 0)
+
+void Jclient::harm_event (Channel *C, jack_midi_event_t *E)
+{
+    int  n, t, v;
+
+    t = E->buffer [0];
+    n = E->buffer [1] & 127;
+    v = E->buffer [2];
+    switch (t & 0xF0)
     {
-        t = E.buffer [0];
-        n = E.buffer [1];
-        v = E.buffer [2];
-        switch (t & 0xF0)
+    case 0x80:
+    case 0x90:
+        if (v && (t & 0x10)) C->_harmkeys [n] += 1;
+        else if (C->_harmkeys [n]) C->_harmkeys [n] -= 1;
+        break;
+    }
+}
+
+
+void Jclient::set_masks (Channel *C)
+{
+    int  i, b, k, n;
+
+    C->_midimask = 0;
+    for (i = 0, b = 1; i < 12; i++, b <<= 1) 
+    {
+        if (C->_notes [i]) C->_midimask |= b;
+    }
+    C->_retuner->set_notemask (C->_midimask ? C->_midimask : C->_notemask);
+
+    // The held harmony notes are given to the voices from the
+    // lowest up. Voices without a note use their fixed interval.
+    for (n = 0, k = 0; (n < 128) && (k < _nvoice); n++)
+    {
+        if (C->_harmkeys [n]) C->_retuner->set_voicenote (k++, n);
+    }
+    while (k < _nvoice) C->_retuner->set_voicenote (k++, -1);
+}
+
+
+void Jclient::pitch_out (Channel *C, void *mbuff, float *cvbuff, int k, int nframes)
+{
+    int                    i, n, b, t;
+    const Retuner::Estim  *E;
+    jack_midi_data_t       d [3];
+
+    // Send the estimates from the last Retuner::process() call,
+    // which started at frame 'k', as MIDI notes and pitch bend,
+    // and as a control signal of 1 per octave relative to 440 Hz.
+    // The bend range is +/- 2 semitones.
+    n = C->_retuner->get_estim (&E);
+    if ((i = C->_retuner->get_nlost ()))
+    {
+        _nlost.store (_nlost.load (std::memory_order_relaxed) + i, std::memory_order_relaxed);
+    }
+    for (i = 0; i < n; i++, E++)
+    {
+        t = k + E->_frame;
+        if (t >= nframes) t = nframes - 1;
+        if (E->_freq > 0)
+        {
+            b = 8192 + (int)(floorf (4096 * E->_bend + 0.5f));
+            if (b < 0) b = 0;
+            if (b > 16383) b = 16383;
+            if (b != C->_outbend)
+            {
+                d [0] = 0xE0;
+                d [1] = b & 127;
+                d [2] = b >> 7;
+                jack_midi_event_write (mbuff, t, d, 3);
+                C->_outbend = b;
+            }
+            if (cvbuff)
+            {
+                while (C->_cvframe < t) cvbuff [C->_cvframe++] = C->_cvvalue;
+                C->_cvvalue = log2f (E->_freq / 440.0f);
+            }
+        }
+        if (E->_note != C->_outnote)
         {
-        case 0x80:
-        case 0x90:
-            if (v && (t & 0x10))
+            if (C->_outnote >= 0)
             {
-                _notes [n % 12] += 1;
+                d [0] = 0x80;
+                d [1] = C->_outnote;
+                d [2] = 0;
+                jack_midi_event_write (mbuff, t, d, 3);
             }
-            else
+            C->_outnote = E->_note;
+            if (C->_outnote >= 0)
             {
-                _notes [n % 12] -= 1;
+                d [0] = 0x90;
+                d [1] = C->_outnote;
+                d [2] = 100;
+                jack_midi_event_write (mbuff, t, d, 3);
             }
-            break;
         }
-        i++;
     }
+}
 
-    _midimask = 0;
-    for (i = 0, b = 1; i < 12; i++, b <<= 1) 
+
+// Frame time of MIDI event 'i' in 'buff', or 'nframes' if there is none.
+
+static int event_time (void *buff, int i, int nframes)
+{
+    jack_midi_event_t  E;
+
+    if (buff && (jack_midi_event_get (&E, buff, i) == 0) && ((int) E.time < nframes)) return E.time;
+    return nframes;
+}
+
+
+void Jclient::osc_fetch (jack_nframes_t f0)
+{
+    int            i, d;
+    Oscctl::Event  E;
+
+    // Keep the pending events sorted by frame time, and in the
+    // order received for the same time. Untimed ones are for the
+    // start of this period. Events that don't fit wait in the queue.
+    while ((_noscev < NOSCEV) && _oscctl.read (&E))
+    {
+        if (! E._timed) E._frame = f0;
+        d = (int32_t)(E._frame - f0);
+        for (i = _noscev; (i > 0) && ((int32_t)(_oscev [i - 1]._frame - f0) > d); i--)
+        {
+            _oscev [i] = _oscev [i - 1];
+        }
+        _oscev [i] = E;
+        _noscev++;
+    }
+}
+
+
+// Frame in this period of pending OSC event 'i', zero if it is
+// late, or 'nframes' if it is for a later period or there is none.
+
+int Jclient::osc_time (int i, jack_nframes_t f0, int nframes)
+{
+    int d;
+
+    if (i >= _noscev) return nframes;
+    d = (int32_t)(_oscev [i]._frame - f0);
+    if (d < 0) return 0;
+    return (d < nframes) ? d : nframes;
+}
+
+
+void Jclient::osc_event (Channel *C, Oscctl::Event *E)
+{
+    // The note mask replaces the one set by the GUI,
+    // a MIDI note mask still has priority.
+    if (E->_param == CTL_NOTES) C->_notemask = (int) E->_value;
+    else C->_retuner->set_param (E->_param, E->_value);
+    _curpar [E->_param].store (E->_value, std::memory_order_relaxed);
+}
+
+
+void Jclient::dry_process (Channel *C, const float *inp, float *out, int nframes)
+{
+    int  i, k;
+
+    // Delay line of '_latency' frames.
+    if (! _latency)
     {
-        if (_notes [i]) _midimask |= b;
+        memcpy (out, inp, nframes * sizeof (float));
+        return;
+    }
+    for (i = 0; i < nframes; i += k)
+    {
+        k = _latency - C->_dryindex;
+        if (k > nframes - i) k = nframes - i;
+        memcpy (out + i, C->_drybuff + C->_dryindex, k * sizeof (float));
+        memcpy (C->_drybuff + C->_dryindex, inp + i, k * sizeof (float));
+        C->_dryindex += k;
+        if (C->_dryindex == _latency) C->_dryindex = 0;
     }
 }
 
 
 int Jclient::jack_process (int nframes)
 {
-    float *inpp;
-    float *outp;
+    int             c, n;
+    jack_nframes_t  f0;
+    uint64_t        t0;
 
     if (!_active) return 0;
 
-    inpp = (float *) jack_port_get_buffer (_ainp_port, nframes);
-    outp = (float *) jack_port_get_buffer (_aout_port, nframes);
-    midi_process (nframes);
-    _retuner->set_notemask (_midimask ? _midimask : _notemask);
-    _retuner->process (nframes, inpp, outp);
+    t0 = Dsptimer::now ();
+    if (_newset.load (std::memory_order_acquire)) take_retuners ();
+    f0 = jack_last_frame_time (_jack_client);
+    osc_fetch (f0);
+
+    // The channels are independent, except for the OSC events which
+    // apply to all of them. Each channel uses the events up to the
+    // end of this period, so they are the same ones for all.
+    n = 0;
+    for (c = 0; c < _nchan; c++)
+    {
+        n = chan_process (_chan + c, nframes, f0, c ? Dsptimer::now () : t0);
+    }
+    _noscev -= n;
+    memmove (_oscev, _oscev + n, _noscev * sizeof (Oscctl::Event));
+    _dsptimer.endcycle (t0);
  
     return 0;
 }
+
+
+int Jclient::chan_process (Channel *C, int nframes, jack_nframes_t f0, uint64_t t)
+{
+    int                i, j, k, n, ip, ih, io;
+    float              *inpp;
+    float              *outp;
+    float              *voutp [Retuner::MAXVOICE];
+    float              *vpart [Retuner::MAXVOICE];
+    void               *pbuff;
+    void               *hbuff;
+    void               *mbuff;
+    float              *cvbuff;
+    jack_midi_event_t  E;
+
+    C->_retuner->set_freewheel (_freewheel);
+    inpp = (float *) jack_port_get_buffer (C->_ainp_port, nframes);
+    outp = (float *) jack_port_get_buffer (C->_aout_port, nframes);
+    for (i = 0; i < _nvoice; i++)
+    {
+        voutp [i] = (float *) jack_port_get_buffer (C->_voice_port [i], nframes);
+    }
+    pbuff = jack_port_get_buffer (C->_midi_port, nframes);
+    hbuff = _nvoice ? jack_port_get_buffer (C->_harm_port, nframes) : 0;
+    mbuff = jack_port_get_buffer (C->_mout_port, nframes);
+    jack_midi_clear_buffer (mbuff);
+    cvbuff = C->_cv_port ? (float *) jack_port_get_buffer (C->_cv_port, nframes) : 0;
+    C->_cvframe = 0;
+
+    // The period is processed in parts that end at the MIDI and
+    // OSC event times, so note mask changes take effect at the
+    // exact frame.
+    ip = ih = io = 0;
+    k = 0;
+    while (true)
+    {
+        // Apply all events at the current frame.
+        while (event_time (pbuff, ip, nframes) <= k)
+        {
+            jack_midi_event_get (&E, pbuff, ip++);
+            midi_event (C, &E);
+        }
+        while (event_time (hbuff, ih, nframes) <= k)
+        {
+            jack_midi_event_get (&E, hbuff, ih++);
+            harm_event (C, &E);
+        }
+        while (osc_time (io, f0, nframes) <= k) osc_event (C, _oscev + io++);
+        set_masks (C);
+        t = _dsptimer.lap (Dsptimer::ST_MIDI, t);
+
+        // Process up to the next event.
+        n = event_time (pbuff, ip, nframes);
+        j = event_time (hbuff, ih, nframes);
+        if (j < n) n = j;
+        j = osc_time (io, f0, nframes);
+        if (j < n) n = j;
+        for (i = 0; i < _nvoice; i++) vpart [i] = voutp [i] + k;
+        // The Retuner times its own stages.
+        C->_retuner->process (n - k, inpp + k, outp + k, vpart);
+        t = Dsptimer::now ();
+        pitch_out (C, mbuff, cvbuff, k, nframes);
+        t = _dsptimer.lap (Dsptimer::ST_OUTPUT, t);
+        if (n == nframes) break;
+        k = n;
+    }
+    if (cvbuff)
+    {
+        while (C->_cvframe < nframes) cvbuff [C->_cvframe++] = C->_cvvalue;
+    }
+    if (C->_dry_port) dry_process (C, inpp, (float *) jack_port_get_buffer (C->_dry_port, nframes), nframes);
+    _dsptimer.lap (Dsptimer::ST_OUTPUT, t);
+
+    return io;
+}
@@ -24,51 +24,174 @@
 
 
 #include <jack/jack.h>
+#include <jack/midiport.h>
+#include <semaphore.h>
 #include <clthreads.h>
 #include "retuner.h"
+#include "oscctl.h"
 
 
 class Jclient : public A_thread
 {
 public:
 
-    Jclient (const char *jname, const char *jserv);
+    // Maximum number of pending OSC events.
+    enum { NOSCEV = 64 };
+
+    // Maximum number of channels.
+    enum { MAXCHAN = 64 };
+
+    // Pitch estimation in the JACK thread, spread over fragments
+    // in the JACK thread, or in a separate thread.
+    enum { EST_INLINE, EST_SPREAD, EST_ASYNC };
+
+    // Optional output ports: the detected pitch as a control signal,
+    // and the input delayed by the processing latency.
+    enum { PORT_CV = 1, PORT_DRY = 2 };
+
+    // With 'nvoice' > 0 there is an output port for each harmony
+    // voice, and a MIDI input to select the notes they sing.
+    //
+    // With 'nchan' > 1 there are that many independent channels, each
+    // with its own ports and Retuner, all processed in the same JACK
+    // callback. The channel number is then added to the port names,
+    // e.g. 'in.1', 'pitch.1'. The parameters set by the functions
+    // below are the same for all channels. They use the Retuner
+    // setters, and can be called from any non-realtime thread.
+    Jclient (const char *jname, const char *jserv, int estim = EST_INLINE,
+             int pdtype = Pitchdet::FFT, int profile = Retuner::PROF_NORMAL,
+             int nvoice = 0, int ports = 0, int nchan = 1);
     ~Jclient (void);
 
     const char *jname (void) { return _jname; }
+    bool shutdown (void) const { return _shutdown; }
     unsigned int fsize (void) const { return _fsize; } 
     unsigned int fsamp (void) const { return _fsamp; } 
-    Retuner *retuner (void) { return _retuner; }
-    void set_notemask (int m) { _notemask = m; } 
+    int nchan (void) const { return _nchan; }
+    void set_refpitch (float v) { set_all (CTL_TUNE, &Retuner::set_refpitch, v); }
+    void set_notebias (float v) { set_all (CTL_BIAS, &Retuner::set_notebias, v); }
+    void set_corrfilt (float v) { set_all (CTL_FILT, &Retuner::set_corrfilt, v); }
+    void set_corrgain (float v) { set_all (CTL_CORR, &Retuner::set_corrgain, v); }
+    void set_corroffs (float v) { set_all (CTL_OFFS, &Retuner::set_corroffs, v); }
+    void set_smoothing (float v);
+    void set_interval (int v, float semit);
+    void set_notemask (int m);
+    // Last value of control parameter 'k' (CTL_*), set either by
+    // the functions above or by OSC.
+    float get_param (int k) const { return _curpar [k].load (std::memory_order_relaxed); }
     void clr_midimask (void);
-    int  get_noteset (void) { return _retuner->get_noteset (); }
-    int  get_midiset (void) { return _midimask; }
+    // The MIDI note set and the telemetry are for the first channel.
+    int  get_midiset (void) { return _chan [0]._midimask; }
+    const Dsptimer *dsptimer (void) const { return &_dsptimer; }
+    const Telemetry *telemetry (void) const { return &_telemetry; }
+    // OSC control on UDP port 'port', see oscctl.h. Returns 0 on success.
+    int start_osc (const char *port) { return _oscctl.start (_jack_client, port); }
+    const char *osc_url (void) const { return _oscctl.url (); }
+    void report (FILE *F) const;
 
 private:
 
+    class Channel
+    {
+    public:
+
+        jack_port_t    *_ainp_port;
+        jack_port_t    *_aout_port;
+        jack_port_t    *_midi_port;
+        jack_port_t    *_harm_port;
+        jack_port_t    *_voice_port [Retuner::MAXVOICE];
+        jack_port_t    *_mout_port;
+        jack_port_t    *_cv_port;
+        jack_port_t    *_dry_port;
+        Retuner        *_retuner;
+        Retuner        *_newret;
+        Retuner        *_oldret;
+        int             _notes [12];
+        int             _notemask;
+        int             _midimask;
+        unsigned char   _harmkeys [128];
+        int             _outnote;
+        int             _outbend;
+        int             _cvframe;
+        float           _cvvalue;
+        float          *_drybuff;
+        float          *_newdry;
+        int             _dryindex;
+    };
+
     virtual void thr_main (void) {}
 
-    void init_jack (const char *jname, const char *jserv);
+    void init_jack (const char *jname, const char *jserv, int estim, int pdtype, int profile, int nvoice, int ports, int nchan);
     void close_jack (void);
+    jack_port_t *register_port (const char *name, int c, const char *type, int flags);
+    Retuner *make_retuner (unsigned int fsamp, int c);
+    void build_main (void);
+    void take_retuners (void);
+    void set_all (int k, void (Retuner::*f)(float), float v);
     void jack_shutdown (void);
     int  jack_process (int nframes);
-    void midi_process (int nframes);
+    int  jack_xrun (void);
+    void jack_latency (jack_latency_callback_mode_t mode);
+    void jack_freewheel (int state);
+    int  jack_bufsize (int nframes);
+    int  jack_srate (int fsamp);
+    int  chan_process (Channel *C, int nframes, jack_nframes_t f0, uint64_t t);
+    void midi_event (Channel *C, jack_midi_event_t *E);
+    void harm_event (Channel *C, jack_midi_event_t *E);
+    void set_masks (Channel *C);
+    void pitch_out (Channel *C, void *mbuff, float *cvbuff, int k, int nframes);
+    void dry_process (Channel *C, const float *inp, float *out, int nframes);
+    void osc_fetch (jack_nframes_t f0);
+    int  osc_time (int i, jack_nframes_t f0, int nframes);
+    void osc_event (Channel *C, Oscctl::Event *E);
 
     jack_client_t  *_jack_client;
-    jack_port_t    *_ainp_port;
-    jack_port_t    *_aout_port;
-    jack_port_t    *_midi_port;
     bool            _active;
+    volatile bool   _shutdown;
     const char     *_jname;
     unsigned int    _fsamp;
     unsigned int    _fsize;
-    Retuner        *_retuner;
-    int             _notes [12];
-    int             _notemask;
-    int             _midimask;
+    int             _nchan;
+    Channel        *_chan;
+    int             _nvoice;
+    int             _latency;
+    volatile bool   _freewheel;
+    Dsptimer        _dsptimer;
+    std::atomic<unsigned int> _nlost;
+    Telemetry       _telemetry;
+    Oscctl          _oscctl;
+    int             _noscev;
+    Oscctl::Event   _oscev [NOSCEV];
+    int             _estim;
+    int             _pdtype;
+    int             _profile;
+
+    // The setters above use the Retuners with '_smutex' held. The
+    // build thread holds it from copying the parameters to the new
+    // Retuners until the process thread has taken them, so no value
+    // is lost and no other thread uses '_retuner' while it changes.
+    pthread_mutex_t        _smutex;
+    std::atomic<float>     _curpar [NCTLPAR];
+
+    // New Retuners for a sample rate change are made by the build
+    // thread, and taken by the process thread at the start of a
+    // cycle. The build thread then deletes the old ones.
+    pthread_t              _bthread;
+    sem_t                  _btrig;
+    sem_t                  _bdone;
+    volatile bool          _bstop;
+    volatile unsigned int  _bfsamp;
+    std::atomic<bool>      _newset;
+    int                    _newlat;
 
     static void jack_static_shutdown (void *arg);
     static int  jack_static_process (jack_nframes_t nframes, void *arg);
+    static int  jack_static_xrun (void *arg);
+    static void jack_static_latency (jack_latency_callback_mode_t mode, void *arg);
+    static void jack_static_freewheel (int state, void *arg);
+    static int  jack_static_bufsize (jack_nframes_t nframes, void *arg);
+    static int  jack_static_srate (jack_nframes_t fsamp, void *arg);
+    static void *static_build (void *arg);
 };
 
 
@@ -39,7 +39,9 @@ Mainwin::Mainwin (X_rootwin *parent, X_resman *xres, int xp, int yp, Jclient *jc
     _xres (xres),
     _jclient (jclient),
     _dirty (false),
-    _managed (false)
+    _managed (false),
+    _tpos (jclient->telemetry ()->position ()),
+    _error (0)
 {
     X_hints     H;
     char        s [256];
@@ -99,11 +101,11 @@ Mainwin::Mainwin (X_rootwin *parent, X_resman *xres, int xp, int yp, Jclient *jc
 
     _notes = 0xFFF;
     _jclient->set_notemask (_notes);
-    _jclient->retuner ()->set_refpitch (_rotary [R_TUNE]->value ());
-    _jclient->retuner ()->set_notebias (_rotary [R_BIAS]->value ());
-    _jclient->retuner ()->set_corrfilt (_rotary [R_FILT]->value ());
-    _jclient->retuner ()->set_corrgain (_rotary [R_CORR]->value ());
-    _jclient->retuner ()->set_corroffs (_rotary [R_OFFS]->value ());
+    _jclient->set_refpitch (_rotary [R_TUNE]->value ());
+    _jclient->set_notebias (_rotary [R_BIAS]->value ());
+    _jclient->set_corrfilt (_rotary [R_FILT]->value ());
+    _jclient->set_corrgain (_rotary [R_CORR]->value ());
+    _jclient->set_corroffs (_rotary [R_OFFS]->value ());
 
     x_add_events (ExposureMask);
     x_map ();
@@ -165,12 +167,30 @@ void Mainwin::clmesg (XClientMessageEvent *E)
 
 void Mainwin::handle_time (void)
 {
-    int   i, k, s;
-    float v;
-
-    v = _jclient->retuner ()->get_error ();
-    _tmeter->update (v, v);
-    k = _jclient->retuner ()->get_noteset ();
+    int                i, k, m, n, s;
+    float              v, v0, v1;
+    const Telemetry    *T;
+    Telemetry::Record  R [32];
+
+    // Take all estimates since the last update. The meter shows
+    // the range of the error, the note buttons all notes that
+    // were corrected to. Without new ones the last error is kept.
+    T = _jclient->telemetry ();
+    v0 = v1 = _error;
+    k = 0;
+    m = 0;
+    while ((n = T->read (&_tpos, R, 32)))
+    {
+        for (i = 0; i < n; i++, m++)
+        {
+            v = R [i]._error;
+            if (! m || (v < v0)) v0 = v;
+            if (! m || (v > v1)) v1 = v;
+            if (R [i]._flags & Telemetry::F_CORR) k |= 1 << (R [i]._note % 12);
+        }
+        _error = v;
+    }
+    _tmeter->update (v0, v1);
     for (i = 0; i < 12; i++)
     {
         s = _bnote [i]->state ();
@@ -241,20 +261,20 @@ void Mainwin::handle_callb (int type, X_window *W, XEvent *E)
         {
         case R_TUNE:
             v = _rotary [R_TUNE]->value ();
-            _jclient->retuner ()->set_refpitch (v);
+            _jclient->set_refpitch (v);
             showval (k);
             break;
         case R_BIAS:
-            _jclient->retuner ()->set_notebias (_rotary [R_BIAS]->value ());
+            _jclient->set_notebias (_rotary [R_BIAS]->value ());
             break;
         case R_FILT:
-            _jclient->retuner ()->set_corrfilt (_rotary [R_FILT]->value ());
+            _jclient->set_corrfilt (_rotary [R_FILT]->value ());
             break;
         case R_CORR:
-            _jclient->retuner ()->set_corrgain (_rotary [R_CORR]->value ());
+            _jclient->set_corrgain (_rotary [R_CORR]->value ());
             break;
         case R_OFFS:
-            _jclient->retuner ()->set_corroffs (_rotary [R_OFFS]->value ());
+            _jclient->set_corroffs (_rotary [R_OFFS]->value ());
             showval (k);
             break;
         }
@@ -365,15 +385,15 @@ void Mainwin::load_state ()
         statefile.close();
 
         _rotary [R_TUNE]->set_value (tune);
-        _jclient->retuner ()->set_refpitch (_rotary [R_TUNE]->value ());
+        _jclient->set_refpitch (_rotary [R_TUNE]->value ());
         _rotary [R_BIAS]->set_value (bias);
-        _jclient->retuner ()->set_notebias (_rotary [R_BIAS]->value ());
+        _jclient->set_notebias (_rotary [R_BIAS]->value ());
         _rotary [R_FILT]->set_value (filt);
-        _jclient->retuner ()->set_corrfilt (_rotary [R_FILT]->value ());
+        _jclient->set_corrfilt (_rotary [R_FILT]->value ());
         _rotary [R_CORR]->set_value (corr);
-        _jclient->retuner ()->set_corrgain (_rotary [R_CORR]->value ());
+        _jclient->set_corrgain (_rotary [R_CORR]->value ());
         _rotary [R_OFFS]->set_value (offs);
-        _jclient->retuner ()->set_corroffs (_rotary [R_OFFS]->value ());
+        _jclient->set_corroffs (_rotary [R_OFFS]->value ());
 
         _notes = notes;
         _jclient->set_notemask (_notes);
@@ -82,6 +82,8 @@ private:
     string          _statefile;
     bool            _dirty;
     bool            _managed;
+    uint32_t        _tpos;
+    float           _error;
 };
 
 
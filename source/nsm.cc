@@ -20,6 +20,7 @@
 
 #include "nsm.h"
 #include "mainwin.h"
+#include "headless.h"
 
 #include <stdio.h>
 #include <sys/stat.h>
@@ -27,6 +28,7 @@
 #include <unistd.h>
 
 extern Mainwin    *mainwin;
+extern Headless   *headless;
 
 NSM_Client::NSM_Client()
 {
@@ -38,7 +40,8 @@ NSM_Client::command_save(char **out_msg)
     (void) out_msg;
     int r = ERR_OK;
 
-    mainwin->save_state ();
+    if (mainwin) mainwin->save_state ();
+    if (headless) headless->save_state ();
 
     return r;
 }
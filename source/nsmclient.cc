@@ -138,6 +138,12 @@ namespace NSM
             while ( lo_server_recv_noblock( _server, 0 ) ) {}
     }
 
+    int
+    Client::fd ( void )
+    {
+        return lo_server_get_socket_fd( _server );
+    }
+
     void
     Client::start ( )
     {
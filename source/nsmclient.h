@@ -81,6 +81,9 @@ namespace NSM
         /* call this periodically to check for new messages */
         void check ( int timeout = 0 );
 
+        /* or when this socket is readable */
+        int fd ( void );
+
         /* or call these to start and stop a thread (must do your own locking in handler!) */
         void start ( void );
         void stop ( void );
@@ -0,0 +1,186 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2010 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "oscctl.h"
+
+
+Oscctl::Oscctl (void) :
+    _client (0),
+    _server (0),
+    _url (0),
+    _depth (0),
+    _nwr (0),
+    _nrd (0)
+{
+}
+
+
+Oscctl::~Oscctl (void)
+{
+    stop ();
+}
+
+
+int Oscctl::start (jack_client_t *client, const char *port)
+{
+    int       k;
+    lo_server S;
+
+    if (_server) return 0;
+    _client = client;
+    _server = lo_server_thread_new (port, 0);
+    if (! _server) return -1;
+    for (k = 0; k < NCTLPAR; k++)
+    {
+        lo_server_thread_add_method (_server, ctlparams [k].name, 0, static_message, this);
+    }
+    // Bundles must be dispatched when they arrive, not when
+    // they are due, so the timetag can be converted here.
+    S = lo_server_thread_get_server (_server);
+    lo_server_enable_queue (S, 0, 1);
+    lo_server_add_bundle_handlers (S, static_bundle_start, static_bundle_end, this);
+    _url = lo_server_thread_get_url (_server);
+    return lo_server_thread_start (_server);
+}
+
+
+void Oscctl::stop (void)
+{
+    if (! _server) return;
+    lo_server_thread_stop (_server);
+    lo_server_thread_free (_server);
+    _server = 0;
+    free (_url);
+    _url = 0;
+}
+
+
+int Oscctl::static_message (const char *path, const char *types, lo_arg **argv, int argc, lo_message, void *arg)
+{
+    int k;
+
+    if (argc < 1) return 1;
+    for (k = 0; k < NCTLPAR; k++)
+    {
+        if (! strcmp (path, ctlparams [k].name))
+        {
+            ((Oscctl *) arg)->message (k, argv [0], types [0]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+int Oscctl::static_bundle_start (lo_timetag t, void *arg)
+{
+    ((Oscctl *) arg)->bundle_start (t);
+    return 0;
+}
+
+
+int Oscctl::static_bundle_end (void *arg)
+{
+    ((Oscctl *) arg)->bundle_end ();
+    return 0;
+}
+
+
+void Oscctl::bundle_start (lo_timetag t)
+{
+    lo_timetag  now;
+    double      d;
+
+    // Convert the timetag to a JACK frame time, using the time from
+    // now. A nested bundle can't be earlier than the one containing
+    // it, so only the innermost timetag matters. An immediate one
+    // inherits the time of its parent.
+    if (_depth < MAXDEPTH)
+    {
+        _timed [_depth] = (t.sec != 0) || (t.frac != 1);
+        if (! _timed [_depth] && _depth)
+        {
+            _timed [_depth] = _timed [_depth - 1];
+            _frame [_depth] = _frame [_depth - 1];
+        }
+        else if (_timed [_depth])
+        {
+            lo_timetag_now (&now);
+            d = lo_timetag_diff (t, now);
+            _frame [_depth] = jack_time_to_frames (_client, jack_get_time () + (int64_t)(1e6 * d));
+        }
+    }
+    _depth++;
+}
+
+
+void Oscctl::bundle_end (void)
+{
+    if (_depth) _depth--;
+}
+
+
+void Oscctl::message (int k, lo_arg *arg, char type)
+{
+    uint32_t  n;
+    float     v;
+    Event     *E;
+
+    switch (type)
+    {
+    case 'f': v = arg->f; break;
+    case 'd': v = arg->d; break;
+    case 'i': v = arg->i; break;
+    case 'h': v = arg->h; break;
+    default: return;
+    }
+    if (v < ctlparams [k].vmin) v = ctlparams [k].vmin;
+    if (v > ctlparams [k].vmax) v = ctlparams [k].vmax;
+
+    // If the queue is full the message is dropped.
+    n = _nwr.load (std::memory_order_relaxed);
+    if (n - _nrd.load (std::memory_order_acquire) == NQUEUE) return;
+    E = _queue + n % NQUEUE;
+    E->_param = k;
+    E->_value = v;
+    E->_timed = false;
+    if (_depth && (_depth <= MAXDEPTH) && _timed [_depth - 1])
+    {
+        E->_timed = true;
+        E->_frame = _frame [_depth - 1];
+    }
+    _nwr.store (n + 1, std::memory_order_release);
+}
+
+
+bool Oscctl::read (Event *E)
+{
+    uint32_t  n;
+
+    n = _nrd.load (std::memory_order_relaxed);
+    if (n == _nwr.load (std::memory_order_acquire)) return false;
+    *E = _queue [n % NQUEUE];
+    _nrd.store (n + 1, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,93 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2010 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+
+#ifndef __OSCCTL_H
+#define __OSCCTL_H
+
+
+#include <stdint.h>
+#include <atomic>
+#include <jack/jack.h>
+#include <lo/lo.h>
+#include "ctlparams.h"
+
+
+// OSC control of the parameters in ctlparams.h, using the same names
+// as paths, e.g. '/autotune/notes i 2741'. Messages are received by
+// a liblo server thread and passed to the process thread in a single
+// reader, single writer queue. Messages in a bundle with a timetag
+// are marked with the corresponding JACK frame time, so the process
+// thread can apply them at that frame. Others, and late ones, are
+// applied at the start of the next period.
+
+class Oscctl
+{
+public:
+
+    class Event
+    {
+    public:
+
+        jack_nframes_t  _frame;
+        bool            _timed;
+        int             _param;   // CTL_*
+        float           _value;
+    };
+
+    Oscctl (void);
+    ~Oscctl (void);
+
+    // Start the server on UDP port 'port'. Returns 0 on success.
+    int start (jack_client_t *client, const char *port);
+    const char *url (void) const { return _url; }
+
+    // Must be called before the JACK client is closed.
+    void stop (void);
+
+    // Process thread only. Returns false if there are no more events.
+    bool read (Event *E);
+
+private:
+
+    enum { NQUEUE = 256, MAXDEPTH = 8 };
+
+    void message (int k, lo_arg *arg, char type);
+    void bundle_start (lo_timetag t);
+    void bundle_end (void);
+
+    static int static_message (const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void *arg);
+    static int static_bundle_start (lo_timetag t, void *arg);
+    static int static_bundle_end (void *arg);
+
+    jack_client_t          *_client;
+    lo_server_thread        _server;
+    char                   *_url;
+    int                     _depth;
+    bool                    _timed [MAXDEPTH];
+    jack_nframes_t          _frame [MAXDEPTH];
+    Event                   _queue [NQUEUE];
+    std::atomic<uint32_t>   _nwr;
+    std::atomic<uint32_t>   _nrd;
+};
+
+
+#endif
@@ -0,0 +1,410 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2009-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pitchdet.h"
+#include "wisdom.h"
+
+
+static const char *names [Pitchdet::NTYPE] = { "fft", "mpm" };
+
+
+Pitchdet *Pitchdet::create (int type, int fsamp, int size, int ifmin, int ifmax, Arena *arena)
+{
+    switch (type)
+    {
+    case FFT: return new Pitchdet_fft (fsamp, size, ifmin, ifmax, arena);
+    case MPM: return new Pitchdet_mpm (fsamp, size, ifmin, ifmax, arena);
+    }
+    return 0;
+}
+
+
+size_t Pitchdet::memsize (int type, int size, int ifmin, int ifmax)
+{
+    switch (type)
+    {
+    case FFT: return Pitchdet_fft::memsize (size);
+    case MPM: return Pitchdet_mpm::memsize (size, ifmin, ifmax);
+    }
+    return 0;
+}
+
+
+const char *Pitchdet::name (int type)
+{
+    return ((type >= 0) && (type < NTYPE)) ? names [type] : "?";
+}
+
+
+int Pitchdet::find (const char *name)
+{
+    int i;
+
+    for (i = 0; i < NTYPE; i++)
+    {
+        if (! strcmp (name, names [i])) return i;
+    }
+    return -1;
+}
+
+
+// ------------------------------------------------------------------------------
+
+
+Pitchdet_fft::Pitchdet_fft (int fsamp, int size, int ifmin, int ifmax, Arena *arena) :
+    Pitchdet (fsamp, size, ifmin, ifmax, arena, memsize (size)),
+    _planner (false),
+    _planstop (false),
+    _newplans (0),
+    _newfwd (0),
+    _newinv (0),
+    _oldfwd (0),
+    _oldinv (0)
+{
+    int   i, h;
+    float t, x, y;
+
+    _fftTwind = _arena->falloc (_size); // Window function 
+    _fftWcorr = _arena->falloc (_size); // Autocorrelation of window 
+    _fftTdata = _arena->falloc (_size); // Time domain data for FFT
+    _fftFdata = (fftwf_complex *) _arena->alloc ((_size / 2 + 1) * sizeof (fftwf_complex));
+
+    // FFTW3 plans, measured ones if available.
+    _planok = wisdom_plans (_size, _fftTdata, _fftFdata, &_fwdplan, &_invplan);
+
+    // Create window, raised cosine.
+    for (i = 0; i < _size; i++)
+    {
+        _fftTwind [i] = 0.5 * (1 - cosf (2 * M_PI * i / _size));
+    }
+
+    // Compute window autocorrelation and normalise it.
+    fftwf_execute_dft_r2c (_fwdplan, _fftTwind, _fftFdata);    
+    h = _size / 2;
+    for (i = 0; i < h; i++)
+    {
+        x = _fftFdata [i][0];
+        y = _fftFdata [i][1];
+        _fftFdata [i][0] = x * x + y * y;
+        _fftFdata [i][1] = 0;
+    }
+    _fftFdata [h][0] = 0;
+    _fftFdata [h][1] = 0;
+    fftwf_execute_dft_c2r (_invplan, _fftFdata, _fftWcorr);    
+    t = _fftWcorr [0];
+    for (i = 0; i < _size; i++)
+    {
+        _fftWcorr [i] /= t;
+    }
+
+    // Use fixed size code for the profile sizes.
+    switch (_size)
+    {
+    case 1024: _kernel = &Pitchdet_fft::kernel<1024>; break;
+    case 2048: _kernel = &Pitchdet_fft::kernel<2048>; break;
+    case 4096: _kernel = &Pitchdet_fft::kernel<4096>; break;
+    default:   _kernel = &Pitchdet_fft::kernel<0>;
+    }
+}
+
+
+Pitchdet_fft::~Pitchdet_fft (void)
+{
+    // The planner doesn't start a new measurement once this is
+    // set, so this waits at most for the current one.
+    _planstop = true;
+    if (_planner) pthread_join (_planthr, 0);
+    if (_newplans == 1)
+    {
+        wisdom_destroy (_newfwd);
+        wisdom_destroy (_newinv);
+    }
+    if (_oldfwd) wisdom_destroy (_oldfwd);
+    if (_oldinv) wisdom_destroy (_oldinv);
+    wisdom_destroy (_fwdplan);
+    wisdom_destroy (_invplan);
+}
+
+
+size_t Pitchdet_fft::memsize (int size)
+{
+    return 3 * Arena::round (size * sizeof (float)) + Arena::round ((size / 2 + 1) * sizeof (fftwf_complex));
+}
+
+
+int Pitchdet_fft::start_planner (void)
+{
+    int                 rv;
+    pthread_attr_t      attr;
+    struct sched_param  parm;
+
+    if (_planok || _planner) return 0;
+    // Not realtime, even if called from a realtime thread.
+    parm.sched_priority = 0;
+    pthread_attr_init (&attr);
+    pthread_attr_setinheritsched (&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy (&attr, SCHED_OTHER);
+    pthread_attr_setschedparam (&attr, &parm);
+    rv = pthread_create (&_planthr, &attr, static_plan, this);
+    pthread_attr_destroy (&attr);
+    if (rv) return rv;
+    _planner = true;
+    return 0;
+}
+
+
+void *Pitchdet_fft::static_plan (void *arg)
+{
+    ((Pitchdet_fft *) arg)->plan_main ();
+    return 0;
+}
+
+
+void Pitchdet_fft::plan_main (void)
+{
+    float          *tdata;
+    fftwf_complex  *fdata;
+
+    // Measure and save the new plans. These buffers are only
+    // used to provide the array alignment.
+    tdata = (float *) fftwf_malloc (_size * sizeof (float));
+    fdata = (fftwf_complex *) fftwf_malloc ((_size / 2 + 1) * sizeof (fftwf_complex));
+    if (! wisdom_measure (_size, tdata, fdata, &_newfwd, &_newinv, &_planstop))
+    {
+        _newplans.store (1, std::memory_order_release);
+    }
+    fftwf_free (tdata);
+    fftwf_free (fdata);
+}
+
+
+float Pitchdet_fft::findcycle (const float *data)
+{
+    stage (0, data);
+    stage (1, data);
+    return stage (2, data);
+}
+
+
+float Pitchdet_fft::stage (int k, const float *data)
+{
+    return (this->*_kernel) (k, data);
+}
+
+
+// The stages for a size known at compile time, or for '_size' if N
+// is zero. The profile sizes are instantiated, so the loops over the
+// FFT data have fixed trip counts.
+
+template <int N> float Pitchdet_fft::kernel (int k, const float *data)
+{
+    int    h, i, j, size;
+    float  f, m, t, x, y, z;
+
+    size = N ? N : _size;
+    h = size / 2;
+    switch (k)
+    {
+    case 0:
+        if (_newplans.load (std::memory_order_acquire) == 1)
+        {
+            // Switch to the measured plans. The old ones can't be
+            // destroyed here, that is done by the destructor.
+            _oldfwd = _fwdplan;
+            _oldinv = _invplan;
+            _fwdplan = _newfwd;
+            _invplan = _newinv;
+            _newplans.store (2, std::memory_order_relaxed);
+        }
+        for (i = 0; i < size; i++) _fftTdata [i] = _fftTwind [i] * data [i];
+        fftwf_execute_dft_r2c (_fwdplan, _fftTdata, _fftFdata);    
+        return 0;
+
+    case 1:
+        f = _fsamp / (size * 2.5e3f);
+        for (i = 0; i < h; i++)
+        {
+            x = _fftFdata [i][0];
+            y = _fftFdata [i][1];
+            m = i * f;
+            _fftFdata [i][0] = (x * x + y * y) / (1 + m * m);
+            _fftFdata [i][1] = 0;
+        }
+        _fftFdata [h][0] = 0;
+        _fftFdata [h][1] = 0;
+        fftwf_execute_dft_c2r (_invplan, _fftFdata, _fftTdata);    
+        return 0;
+    }
+
+    // Normalise and find the peak.
+    t = _fftTdata [0] + 0.1f;
+    for (i = 0; i < h; i++) _fftTdata [i] /= (t * _fftWcorr [i]);
+    x = _fftTdata [0];
+    for (i = 4; i < _ifmax; i += 4)
+    {
+        y = _fftTdata [i];
+        if (y > x) break;
+        x = y;
+    }
+    i -= 4;
+    if (i >= _ifmax) return 0;
+    if (i <  _ifmin) i = _ifmin;
+    x = _fftTdata [--i];
+    y = _fftTdata [++i];
+    m = 0;
+    j = 0;
+    while (i <= _ifmax)
+    {
+        t = y * _fftWcorr [i];
+        z = _fftTdata [++i];
+        if ((t >  m) && (y >= x) && (y >= z) && (y > 0.8f))
+        {
+            j = i - 1;
+            m = t;
+        }
+        x = y;
+        y = z;
+    }
+    if (j)
+    {
+        x = _fftTdata [j - 1];
+        y = _fftTdata [j];
+        z = _fftTdata [j + 1];
+        return j + 0.5f * (x - z) / (z - 2 * y + x - 1e-9f);
+    }
+    return 0;
+}
+
+
+
+// ------------------------------------------------------------------------------
+
+
+Pitchdet_mpm::Pitchdet_mpm (int fsamp, int size, int ifmin, int ifmax, Arena *arena) :
+    Pitchdet (fsamp, size, ifmin, ifmax, arena, memsize (size, ifmin, ifmax))
+{
+    // One extra lag on both sides for peak interpolation.
+    _lag0 = (_ifmin > 1) ? _ifmin - 1 : 1;
+    _nlag = _ifmax + 2 - _lag0;
+    _wlen = _size - _ifmax - 1;
+    _e0 = _e1 = 0;
+    _nsdf = _arena->falloc (_nlag);
+}
+
+
+Pitchdet_mpm::~Pitchdet_mpm (void)
+{
+}
+
+
+size_t Pitchdet_mpm::memsize (int, int ifmin, int ifmax)
+{
+    return Arena::round ((ifmax + 2 - ((ifmin > 1) ? ifmin - 1 : 1)) * sizeof (float));
+}
+
+
+static float dotprod (const float *a, const float *b, int n)
+{
+    int    i;
+    float  s0, s1, s2, s3;
+
+    // Four partial sums to allow vectorisation.
+    s0 = s1 = s2 = s3 = 0;
+    for (i = 0; i < n - 3; i += 4)
+    {
+        s0 += a [i + 0] * b [i + 0];
+        s1 += a [i + 1] * b [i + 1];
+        s2 += a [i + 2] * b [i + 2];
+        s3 += a [i + 3] * b [i + 3];
+    }
+    for (; i < n; i++) s0 += a [i] * b [i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+
+float Pitchdet_mpm::findcycle (const float *data)
+{
+    int k;
+
+    for (k = 0; k < NSTAGE - 1; k++) stage (k, data);
+    return stage (k, data);
+}
+
+
+float Pitchdet_mpm::stage (int s, const float *data)
+{
+    int    i, k, k1, n;
+    float  m, x, y, z;
+
+    // Normalised square difference function, using a fixed
+    // window of '_wlen' samples. The energy of the lagged part
+    // is updated incrementally.
+    n = _nlag;
+    if (s == 0)
+    {
+        _e0 = dotprod (data, data, _wlen);
+        _e1 = dotprod (data + _lag0, data + _lag0, _wlen);
+    }
+    k1 = ((s + 1) * n) / NSTAGE;
+    for (k = (s * n) / NSTAGE; k < k1; k++)
+    {
+        i = _lag0 + k;
+        _nsdf [k] = 2 * dotprod (data, data + i, _wlen) / (_e0 + _e1 + 1e-20f);
+        // Not after the last lag, 'data [i + _wlen]' would be
+        // one past the end.
+        if (k + 1 < n)
+        {
+            x = data [i];
+            y = data [i + _wlen];
+            _e1 += y * y - x * x;
+        }
+    }
+    if (s < NSTAGE - 1) return 0;
+
+    // Skip the part of the zero lag peak that is in range.
+    for (i = 1; (i < n - 1) && (_nsdf [i] <= _nsdf [i - 1]); i++);
+
+    // Find the highest peak, then take the first one that
+    // is close to it. This avoids octave errors.
+    m = 0;
+    for (k = i; k < n - 1; k++)
+    {
+        y = _nsdf [k];
+        if ((y > m) && (y >= _nsdf [k - 1]) && (y >= _nsdf [k + 1])) m = y;
+    }
+    if (m < 0.8f) return 0;
+    m *= 0.9f;
+    for (k = i; k < n - 1; k++)
+    {
+        x = _nsdf [k - 1];
+        y = _nsdf [k];
+        z = _nsdf [k + 1];
+        if ((y >= m) && (y >= x) && (y >= z))
+        {
+            return _lag0 + k + 0.5f * (x - z) / (z - 2 * y + x - 1e-9f);
+        }
+    }
+    return 0;
+}
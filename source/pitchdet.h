@@ -0,0 +1,179 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2009-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+
+#ifndef __PITCHDET_H
+#define __PITCHDET_H
+
+
+#include <atomic>
+#include <pthread.h>
+#include <fftw3.h>
+#include "arena.h"
+
+
+// Pitch detector interface. The input is a block of 'size' samples
+// at 'fsamp', and the result the length of one cycle in samples,
+// or zero if no pitch was found. Only cycle lengths in the range
+// 'ifmin'..'ifmax' samples are considered.
+//
+// A detector is used by one thread at a time, but that need not
+// be the one that created it.
+//
+// Buffers are taken from 'arena' if given, which must have at least
+// memsize() bytes free for them. Otherwise the detector makes its own.
+
+
+class Pitchdet
+{
+public:
+
+    enum { FFT, MPM, NTYPE };
+
+    static Pitchdet *create (int type, int fsamp, int size, int ifmin, int ifmax, Arena *arena = 0);
+    static size_t memsize (int type, int size, int ifmin, int ifmax);
+    static const char *name (int type);
+    static int find (const char *name);
+
+    virtual ~Pitchdet (void) { delete _ownarena; }
+
+    virtual float findcycle (const float *data) = 0;
+
+    // The same work as findcycle() split into 'nstage()' parts of
+    // similar cost. Calling stage (k, data) for k = 0 .. nstage() - 1
+    // in order and with the same data gives the same result as
+    // findcycle (data), returned by the last stage.
+    virtual int   nstage (void) const { return 1; }
+    virtual float stage (int k, const float *data) { return findcycle (data); }
+
+    // Start a background thread to improve the detector's
+    // performance, if that applies.
+    virtual int start_planner (void) { return 0; }
+
+protected:
+
+    Pitchdet (int fsamp, int size, int ifmin, int ifmax, Arena *arena, size_t memsize) :
+        _fsamp (fsamp),
+        _size (size),
+        _ifmin (ifmin),
+        _ifmax (ifmax),
+        _ownarena (arena ? 0 : new Arena (memsize)),
+        _arena (arena ? arena : _ownarena)
+    {
+    }
+
+    int              _fsamp;
+    int              _size;
+    int              _ifmin;
+    int              _ifmax;
+    Arena           *_ownarena;
+    Arena           *_arena;
+};
+
+
+// Autocorrelation computed by FFT, of the windowed input, with the
+// spectrum weighted to reduce the influence of higher harmonics.
+// Cost is independent of the lag range.
+
+class Pitchdet_fft : public Pitchdet
+{
+public:
+
+    Pitchdet_fft (int fsamp, int size, int ifmin, int ifmax, Arena *arena = 0);
+    virtual ~Pitchdet_fft (void);
+
+    static size_t memsize (int size);
+
+    virtual float findcycle (const float *data);
+
+    // Window and forward FFT, weighting and inverse FFT, and
+    // the peak search.
+    virtual int   nstage (void) const { return 3; }
+    virtual float stage (int k, const float *data);
+
+    // If no measured FFT plans were found for this size, find
+    // them in a background thread and save them for the next
+    // time. The new plans are used as soon as they are ready.
+    virtual int start_planner (void);
+
+private:
+
+    void  plan_main (void);
+
+    template <int N> float kernel (int k, const float *data);
+
+    static void *static_plan (void *arg);
+
+    float  (Pitchdet_fft::*_kernel) (int k, const float *data);
+
+    float           *_fftTwind;
+    float           *_fftWcorr;
+    float           *_fftTdata;
+    fftwf_complex   *_fftFdata;
+    fftwf_plan       _fwdplan;
+    fftwf_plan       _invplan;
+    bool             _planok;
+    bool             _planner;
+    volatile bool    _planstop;
+    pthread_t        _planthr;
+    std::atomic<int> _newplans;
+    fftwf_plan       _newfwd;
+    fftwf_plan       _newinv;
+    fftwf_plan       _oldfwd;
+    fftwf_plan       _oldinv;
+};
+
+
+// McLeod pitch method. The normalised square difference function
+// is computed directly, and only for lags in the accepted range.
+// Cost is proportional to the lag range, and to the window length,
+// which is 'size' minus the maximum lag.
+
+class Pitchdet_mpm : public Pitchdet
+{
+public:
+
+    Pitchdet_mpm (int fsamp, int size, int ifmin, int ifmax, Arena *arena = 0);
+    virtual ~Pitchdet_mpm (void);
+
+    static size_t memsize (int size, int ifmin, int ifmax);
+
+    virtual float findcycle (const float *data);
+
+    // Each stage computes a quarter of the lags, the
+    // last one also does the peak search.
+    virtual int   nstage (void) const { return NSTAGE; }
+    virtual float stage (int k, const float *data);
+
+private:
+
+    enum { NSTAGE = 4 };
+
+    int              _lag0;
+    int              _nlag;
+    int              _wlen;
+    float            _e0;
+    float            _e1;
+    float           *_nsdf;
+};
+
+
+#endif
@@ -24,27 +24,74 @@
 #include <stdio.h>
 #include <math.h>
 #include "retuner.h"
+#include "interp.h"
 
 
-Retuner::Retuner (int fsamp) :
-    _fsamp (fsamp),
+// Profile parameters for 44.1 and 48 kHz, sizes are in frames at
+// the input sample rate. At higher rates the sizes are scaled to
+// keep the same durations. The analysis window always ends at the
+// most recent input. For the normal and accurate profiles the read
+// delay is half the FFT length, so the estimate is centered on the
+// output. The low latency one trades that for a shorter delay, and
+// a shorter FFT which limits the lowest detected frequency.
+
+static const struct
+{
+    const char  *name;
+    int          frsize;  // Fragment size
+    int          fftlen;  // Analysis length
+    int          nhop;    // Fragments per estimate
+    int          fmin;    // Lowest detected frequency
+    int          ipsize;  // Input buffer size
+    int          rdelay;  // Initial read delay in fragments
+}
+profiles [Retuner::NPROF] =
+{
+    { "normal",   128, 2048, 4,  60, 2048,  8 },
+    { "lowlat",    64, 1024, 4, 100, 2048,  4 },
+    { "accurate", 128, 4096, 4,  50, 4096, 16 }
+};
+
+
+const char *Retuner::profile_name (int profile)
+{
+    return ((profile >= 0) && (profile < NPROF)) ? profiles [profile].name : "?";
+}
+
+
+int Retuner::profile_find (const char *name)
+{
+    int i;
+
+    for (i = 0; i < NPROF; i++)
+    {
+        if (! strcmp (name, profiles [i].name)) return i;
+    }
+    return -1;
+}
+
+
+Retuner::Retuner (int fsamp, int pdtype, int profile) :
     _refpitch (440.0f),
     _notebias (0.0f),
     _corrfilt (1.0f),
     _corrgain (1.0f),
     _corroffs (0.0f),
-    _notemask (0xFFF)
+    _notemask (0xFFF),
+    _fsamp (fsamp),
+    _pwr (0),
+    _prd (1),
+    _pmid (2),
+    _pchange (false)
 {
-    int   i, h;
-    float t, x, y;
+    int   i, m;
 
+    if ((profile < 0) || (profile >= NPROF)) profile = PROF_NORMAL;
     if (_fsamp < 64000)
     {
         // At 44.1 and 48 kHz resample to double rate.
         _upsamp = true;
-        _ipsize = 4096;
-        _fftlen = 2048;
-        _frsize = 128;
+        m = 1;
         _resampler.setup (1, 2, 1, 32); // 32 is medium quality.
         // Prefeed some input samples to remove delay.
         _resampler.inp_count = _resampler.filtlen () - 1;
@@ -57,34 +104,74 @@ Retuner::Retuner (int fsamp) :
     {
         // 88.2 or 96 kHz.
         _upsamp = false;
-        _ipsize = 4096;
-        _fftlen = 4096;
-        _frsize = 256;
+        m = 2;
     }
     else
     {
         // 192 kHz, double time domain buffers sizes.
         _upsamp = false;
-        _ipsize = 8192;
-        _fftlen = 8192;
-        _frsize = 512;
+        m = 4;
+    }
+    _frsize = m * profiles [profile].frsize;
+    _ipsize = m * profiles [profile].ipsize * (_upsamp ? 2 : 1);
+
+    // Pitch estimation is done at 44.1 or 48 kHz. At the higher
+    // rates the input is decimated into a separate buffer, at the
+    // lower ones the upsampled input is used at every 2nd sample.
+    _adecim = _upsamp ? 1 : m;
+    _asamp = _fsamp / _adecim;
+    _fftlen = profiles [profile].fftlen;
+    _apsize = 0;
+    _apindex = 0;
+    _apbuff = 0;
+    if (_adecim > 1)
+    {
+        // Used for analysis only, so lower quality is good enough.
+        // The delay is 'hlen' samples at the analysis rate, 16/48000
+        // or 0.33 ms (0.36 ms at 88.2 kHz and 176.4 kHz). It is not
+        // compensated: it shifts each analysis window of at least
+        // 1024 samples by 16, and delays the correction by less than
+        // 2% of the shortest filter time (20 ms). The cycle length is
+        // not affected, so neither are the jumps.
+        _decimator.setup (_adecim, 1, 1, 16);
+        _apsize = _fftlen;
+    }
+    _nhop = profiles [profile].nhop;
+    _ehop = _nhop;
+    _rdelay = profiles [profile].rdelay;
+
+    // Reference for the jump decision in process(). The read
+    // position is '_rdelay' fragments behind the write position
+    // when the ratio is one.
+    _jumpref = _ipsize / ((_upsamp ? 2 : 1) * _frsize) - _rdelay + 2;
+
+    // Accepted correlation peak range, corresponding to fmin..1200 Hz,
+    // at the analysis sample rate.
+    _ifmin = _asamp / 1200;
+    _ifmax = _asamp / profiles [profile].fmin;
+
+    // Various buffers, all in one arena together with the
+    // ones of the pitch detector.
+    _arena = new Arena (  Arena::round ((_ipsize + 3) * sizeof (float))
+                        + Arena::round (_frsize * sizeof (float))
+                        + Arena::round (_apsize * sizeof (float))
+                        + NSLOT * Arena::round (_fftlen * sizeof (float))
+                        + Pitchdet::memsize (pdtype, _fftlen, _ifmin, _ifmax));
+    _ipbuff = _arena->falloc (_ipsize + 3);  // Resampled or filtered input
+    _xffunc = _arena->falloc (_frsize);      // Crossfade function
+    if (_apsize) _apbuff = _arena->falloc (_apsize);  // Decimated input
+    for (i = 0; i < NSLOT; i++) _snap [i] = _arena->falloc (_fftlen);  // Snapshots for pitch estimation
+
+    // Pitch detector, cycle lengths are at the analysis sample rate
+    // and must be multiplied by '_adecim'.
+    _pitchdet = Pitchdet::create (pdtype, _asamp, _fftlen, _ifmin, _ifmax, _arena);
+    switch (_fftlen)
+    {
+    case 1024: _snapfn = &Retuner::snapshot_n<1024>; break;
+    case 2048: _snapfn = &Retuner::snapshot_n<2048>; break;
+    case 4096: _snapfn = &Retuner::snapshot_n<4096>; break;
+    default:   _snapfn = &Retuner::snapshot_n<0>;
     }
-
-    // Accepted correlation peak range, corresponding to 60..1200 Hz.
-    _ifmin = _fsamp / 1200;
-    _ifmax = _fsamp / 60;
-
-    // Various buffers
-    _ipbuff = new float[_ipsize + 3];  // Resampled or filtered input
-    _xffunc = new float[_frsize];      // Crossfade function
-    _fftTwind = (float *) fftwf_malloc (_fftlen * sizeof (float)); // Window function 
-    _fftWcorr = (float *) fftwf_malloc (_fftlen * sizeof (float)); // Autocorrelation of window 
-    _fftTdata = (float *) fftwf_malloc (_fftlen * sizeof (float)); // Time domain data for FFT
-    _fftFdata = (fftwf_complex *) fftwf_malloc ((_fftlen / 2 + 1) * sizeof (fftwf_complex));
-
-    // FFTW3 plans
-    _fwdplan = fftwf_plan_dft_r2c_1d (_fftlen, _fftTdata, _fftFdata, FFTW_ESTIMATE);
-    _invplan = fftwf_plan_dft_c2r_1d (_fftlen, _fftFdata, _fftTdata, FFTW_ESTIMATE);
 
     // Clear input buffer.
     memset (_ipbuff, 0, (_ipsize + 1) * sizeof (float));
@@ -95,35 +182,16 @@ Retuner::Retuner (int fsamp) :
         _xffunc [i] = 0.5 * (1 - cosf (M_PI * i / _frsize));
     }
 
-    // Create window, raised cosine.
-    for (i = 0; i < _fftlen; i++)
-    {
-        _fftTwind [i] = 0.5 * (1 - cosf (2 * M_PI * i / _fftlen));
-    }
-
-    // Compute window autocorrelation and normalise it.
-    fftwf_execute_dft_r2c (_fwdplan, _fftTwind, _fftFdata);    
-    h = _fftlen / 2;
-    for (i = 0; i < h; i++)
-    {
-        x = _fftFdata [i][0];
-        y = _fftFdata [i][1];
-        _fftFdata [i][0] = x * x + y * y;
-        _fftFdata [i][1] = 0;
-    }
-    _fftFdata [h][0] = 0;
-    _fftFdata [h][1] = 0;
-    fftwf_execute_dft_c2r (_invplan, _fftFdata, _fftWcorr);    
-    t = _fftWcorr [0];
-    for (i = 0; i < _fftlen; i++)
-    {
-        _fftWcorr [i] /= t;
-    }
-
     // Initialise all counters and other state.
-    _notebits = 0;
+    _jumped = false;
+    _telemetry = 0;
     _lastnote = -1;
     _count = 0;
+    _voiced = false;
+    _pitch = 0;
+    _midinote = -1;
+    _nestim = 0;
+    _nlost = 0;
     _cycle = _frsize;
     _error = 0.0f;
     _ratio = 1.0f;
@@ -131,28 +199,353 @@ Retuner::Retuner (int fsamp) :
     _ipindex = 0;
     _frindex = 0;
     _frcount = 0;
-    _rindex1 = _ipsize / 2;
+    // cubic() at position r interpolates between r + 1 and r + 2,
+    // so start one sample earlier to make the delay exactly what
+    // latency() reports.
+    _rindex1 = _ipsize - _rdelay * _frsize * (_upsamp ? 2 : 1) - 1;
     _rindex2 = 0;
+    _timer = 0;
+    _spread = false;
+    _stage = -1;
+    _nvoice = 0;
+    for (i = 0; i < MAXVOICE; i++) _interval [i] = 0;
+    _worker = false;
+    _fwheel = false;
+    _stop = false;
+    _nsnap = 0;
+    _nused = 0;
+    _nres = 0;
+
+    // All parameter buffers start with the current values.
+    pthread_mutex_init (&_pmutex, 0);
+    _pset._refpitch = _refpitch;
+    _pset._notebias = _notebias;
+    _pset._corrfilt = _corrfilt;
+    _pset._corrgain = _corrgain;
+    _pset._corroffs = _corroffs;
+    _pset._smooth = 1.0f;
+    _tfilt = 0;
+    _tsmooth = 0;
+    for (i = 0; i < MAXVOICE; i++) _pset._interval [i] = 0;
+    for (i = 0; i < NPAR; i++) _pset._serial [i] = 0;
+    for (i = 0; i < 3; i++) _param [i] = _pset;
+    _target = _pset;
+    _setmask = 0;
+
+    // Select the interpolation code for this CPU.
+    interp_init (INTERP_AUTO);
 }
 
 
 Retuner::~Retuner (void)
 {
-    delete[] _ipbuff;
-    delete[] _xffunc;
-    fftwf_free (_fftTwind);
-    fftwf_free (_fftWcorr);
-    fftwf_free (_fftTdata);
-    fftwf_free (_fftFdata);
-    fftwf_destroy_plan (_fwdplan);
-    fftwf_destroy_plan (_invplan);
+    if (_worker)
+    {
+        _stop = true;
+        sem_post (&_trig);
+        pthread_join (_thread, 0);
+        sem_destroy (&_trig);
+        sem_destroy (&_done);
+    }
+    delete _pitchdet;
+    delete _arena;
+    pthread_mutex_destroy (&_pmutex);
+}
+
+
+void Retuner::set_refpitch (float v)
+{
+    pthread_mutex_lock (&_pmutex);
+    _pset._refpitch = v;
+    _pset._serial [PAR_REFPITCH]++;
+    sendparam ();
+    pthread_mutex_unlock (&_pmutex);
+}
+
+
+void Retuner::set_notebias (float v)
+{
+    pthread_mutex_lock (&_pmutex);
+    _pset._notebias = v / 13.0f;
+    _pset._serial [PAR_NOTEBIAS]++;
+    sendparam ();
+    pthread_mutex_unlock (&_pmutex);
+}
+
+
+void Retuner::set_corrfilt (float v)
+{
+    pthread_mutex_lock (&_pmutex);
+    _tfilt = v;
+    _pset._corrfilt = (_nhop * _frsize) / (v * _fsamp);
+    _pset._serial [PAR_CORRFILT]++;
+    sendparam ();
+    pthread_mutex_unlock (&_pmutex);
+}
+
+
+void Retuner::set_corrgain (float v)
+{
+    pthread_mutex_lock (&_pmutex);
+    _pset._corrgain = v;
+    _pset._serial [PAR_CORRGAIN]++;
+    sendparam ();
+    pthread_mutex_unlock (&_pmutex);
+}
+
+
+void Retuner::set_corroffs (float v)
+{
+    pthread_mutex_lock (&_pmutex);
+    _pset._corroffs = v;
+    _pset._serial [PAR_CORROFFS]++;
+    sendparam ();
+    pthread_mutex_unlock (&_pmutex);
+}
+
+
+void Retuner::set_smoothing (float v)
+{
+    pthread_mutex_lock (&_pmutex);
+    _tsmooth = v;
+    _pset._smooth = (v > 0) ? 1 - expf (-_frsize / (v * _fsamp)) : 1.0f;
+    sendparam ();
+    pthread_mutex_unlock (&_pmutex);
+}
+
+
+void Retuner::set_param (int k, float v)
+{
+    if ((k < 0) || (k >= NPAR)) return;
+    // Kept for take_param(), until a setter replaces it.
+    _setval [k] = v;
+    _setmask |= 1 << k;
+    // Same conversions as in the setters.
+    switch (k)
+    {
+    case PAR_REFPITCH:
+        _target._refpitch = v;
+        break;
+    case PAR_NOTEBIAS:
+        _notebias = v / 13.0f;
+        return;
+    case PAR_CORRFILT:
+        _corrfilt = (_nhop * _frsize) / (v * _fsamp);
+        return;
+    case PAR_CORRGAIN:
+        _target._corrgain = v;
+        break;
+    case PAR_CORROFFS:
+        _target._corroffs = v;
+        break;
+    }
+    _pchange = true;
+}
+
+
+void Retuner::take_param (Retuner *R)
+{
+    int  k;
+
+    // The serials in '_target' are those of the setter values copied
+    // from R. If R has seen the same ones, its set_param() values are
+    // more recent.
+    for (k = 0; k < NPAR; k++)
+    {
+        if (   (R->_setmask & (1 << k))
+            && (R->_target._serial [k] == _target._serial [k])) set_param (k, R->_setval [k]);
+    }
+    _refpitch = R->_refpitch;
+    _corrgain = R->_corrgain;
+    _corroffs = R->_corroffs;
+    _pchange = true;
+}
+
+
+void Retuner::copy_param (Retuner *R)
+{
+    int  i;
+
+    // Both times are kept in seconds, as the converted values
+    // depend on the sample rate. Nobody else can use this one
+    // yet, so the current values can be set directly as well.
+    pthread_mutex_lock (&R->_pmutex);
+    pthread_mutex_lock (&_pmutex);
+    _pset = R->_pset;
+    _tfilt = R->_tfilt;
+    _tsmooth = R->_tsmooth;
+    if (_tfilt > 0) _pset._corrfilt = (_nhop * _frsize) / (_tfilt * _fsamp);
+    _pset._smooth = (_tsmooth > 0) ? 1 - expf (-_frsize / (_tsmooth * _fsamp)) : 1.0f;
+    _refpitch = _pset._refpitch;
+    _notebias = _pset._notebias;
+    _corrfilt = _pset._corrfilt;
+    _corrgain = _pset._corrgain;
+    _corroffs = _pset._corroffs;
+    for (i = 0; i < MAXVOICE; i++) _interval [i] = _pset._interval [i];
+    for (i = 0; i < 3; i++) _param [i] = _pset;
+    _target = _pset;
+    pthread_mutex_unlock (&_pmutex);
+    pthread_mutex_unlock (&R->_pmutex);
+}
+
+
+void Retuner::set_interval (int v, float semit)
+{
+    if ((v < 0) || (v >= MAXVOICE)) return;
+    if (semit < -12.0f) semit = -12.0f;
+    if (semit >  12.0f) semit =  12.0f;
+    pthread_mutex_lock (&_pmutex);
+    _pset._interval [v] = semit;
+    sendparam ();
+    pthread_mutex_unlock (&_pmutex);
+}
+
+
+void Retuner::set_voices (int n)
+{
+    int    i;
+    Voice  *V;
+
+    if (n < 0) n = 0;
+    if (n > MAXVOICE) n = MAXVOICE;
+    for (i = 0, V = _voice; i < n; i++, V++)
+    {
+        V->_ratio = 1.0f;
+        V->_rindex1 = _rindex1;
+        V->_rindex2 = 0;
+        V->_xfade = false;
+        V->_note = -1;
+    }
+    _nvoice = n;
+}
+
+
+void Retuner::sendparam (void)
+{
+    // Called with the mutex locked. Fill in our buffer and
+    // exchange it with the middle one, marking that as new.
+    _param [_pwr] = _pset;
+    _pwr = _pmid.exchange (_pwr | NEWPAR, std::memory_order_acq_rel) & 3;
+}
+
+
+void Retuner::checkparam (void)
+{
+    Param  *P;
+    float  g;
+    int    k;
+
+    // Take the most recent parameter set if there is a new one.
+    if (_pmid.load (std::memory_order_relaxed) & NEWPAR)
+    {
+        _prd = _pmid.exchange (_prd, std::memory_order_acq_rel) & 3;
+        P = _param + _prd;
+        // Only the parameters changed by the setters replace
+        // the ones set by set_param().
+        if (P->_serial [PAR_REFPITCH] != _target._serial [PAR_REFPITCH]) _target._refpitch = P->_refpitch;
+        if (P->_serial [PAR_NOTEBIAS] != _target._serial [PAR_NOTEBIAS]) _notebias = P->_notebias;
+        if (P->_serial [PAR_CORRFILT] != _target._serial [PAR_CORRFILT]) _corrfilt = P->_corrfilt;
+        if (P->_serial [PAR_CORRGAIN] != _target._serial [PAR_CORRGAIN]) _target._corrgain = P->_corrgain;
+        if (P->_serial [PAR_CORROFFS] != _target._serial [PAR_CORROFFS]) _target._corroffs = P->_corroffs;
+        for (k = 0; k < NPAR; k++)
+        {
+            if (P->_serial [k] != _target._serial [k]) _setmask &= ~(1 << k);
+        }
+        memcpy (_target._serial, P->_serial, sizeof (_target._serial));
+        _target._smooth = P->_smooth;
+        memcpy (_interval, P->_interval, sizeof (_interval));
+        _pchange = true;
+    }
+    if (! _pchange) return;
+
+    // Move the tuning, gain and offset towards their new values.
+    P = &_target;
+    g = P->_smooth;
+    _refpitch += g * (P->_refpitch - _refpitch);
+    _corrgain += g * (P->_corrgain - _corrgain);
+    _corroffs += g * (P->_corroffs - _corroffs);
+    if (   (fabsf (P->_refpitch - _refpitch) < 1e-3f)
+        && (fabsf (P->_corrgain - _corrgain) < 1e-4f)
+        && (fabsf (P->_corroffs - _corroffs) < 1e-4f))
+    {
+        _refpitch = P->_refpitch;
+        _corrgain = P->_corrgain;
+        _corroffs = P->_corroffs;
+        _pchange = false;
+    }
+    _ratio = powf (2.0f, _corroffs / 12.0f - _error * _corrgain);
+}
+
+
+int Retuner::start_worker (int policy, int priority)
+{
+    int                 rv;
+    pthread_attr_t      attr;
+    struct sched_param  parm;
+
+    if (_worker) return 0;
+
+    if (sem_init (&_trig, 0, 0)) return -1;
+    if (sem_init (&_done, 0, 0))
+    {
+        sem_destroy (&_trig);
+        return -1;
+    }
+
+    parm.sched_priority = priority;
+    pthread_attr_init (&attr);
+    pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_JOINABLE);
+    pthread_attr_setinheritsched (&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy (&attr, policy);
+    pthread_attr_setschedparam (&attr, &parm);
+    pthread_attr_setscope (&attr, PTHREAD_SCOPE_SYSTEM);
+    rv = pthread_create (&_thread, &attr, static_main, this);
+    pthread_attr_destroy (&attr);
+    if (rv)
+    {
+        sem_destroy (&_trig);
+        sem_destroy (&_done);
+        return rv;
+    }
+    _worker = true;
+    return 0;
+}
+
+
+void *Retuner::static_main (void *arg)
+{
+    ((Retuner *) arg)->thr_main ();
+    return 0;
 }
 
 
-int Retuner::process (int nfram, float *inp, float *out)
+void Retuner::thr_main (void)
 {
-    int    i, k, fi;
-    float  ph, dp, r1, r2, dr, u1, u2, v;
+    int k, n;
+
+    // Each post on the semaphore corresponds to one snapshot.
+    // Snapshots are processed in order, and the result count
+    // is published only after the result has been written.
+    // Each result is also posted on '_done' for syncycle().
+    n = 0;
+    while (true)
+    {
+        sem_wait (&_trig);
+        if (_stop) break;
+        k = n % NSLOT;
+        _wcycle [k] = _adecim * _pitchdet->findcycle (_snap [k]);
+        _nres.store (++n, std::memory_order_release);
+        sem_post (&_done);
+    }
+}
+
+
+int Retuner::process (int nfram, float *inp, float *out, float *vout [])
+{
+    int       k, v, fi, fo;
+    float     r1, r2, dr;
+    uint64_t  t;
+    Voice     *V;
 
     // Pitch shifting is done by resampling the input at the
     // required ratio, and eventually jumping forward or back
@@ -160,13 +553,16 @@ int Retuner::process (int nfram, float *inp, float *out)
     // fragments of '_frsize' frames, and the decision to jump
     // forward or back is taken at the start of each fragment.
     // If a jump happens we crossfade over one fragment size. 
-    // Every 4 fragments a new pitch estimate is made. Since
-    // _fftsize = 16 * _frsize, the estimation window moves
-    // by 1/4 of the FFT length.
+    // Every '_nhop' fragments a new pitch estimate is made,
+    // on the most recent '_fftlen' frames of analysis input.
 
+    _nestim = 0;
+    _nlost = 0;
     fi = _frindex;  // Write index in current fragment.
+    fo = 0;         // Output index for the harmony voices.
     r1 = _rindex1;  // Read index for current input frame.
     r2 = _rindex2;  // Second read index while crossfading. 
+    t = _timer ? Dsptimer::now () : 0;
 
     // No assumptions are made about fragments being aligned
     // with process() calls, so we may be in the middle of
@@ -189,12 +585,14 @@ int Retuner::process (int nfram, float *inp, float *out)
             _resampler.process ();
             _ipindex += 2 * k;
         }
-        // At higher sample rates apply lowpass filter.
+        // At higher sample rates the input is used as it is,
+        // only the analysis input is decimated.
         else
         {
-            // Not implemented yet, just copy.
             memcpy (_ipbuff + _ipindex, inp, k * sizeof (float));
             _ipindex += k;
+            // Decimated input for pitch estimation.
+            decimate (k, inp);
         }
 
         // Extra samples for interpolation.
@@ -203,6 +601,7 @@ int Retuner::process (int nfram, float *inp, float *out)
         _ipbuff [_ipsize + 2] = _ipbuff [2];
         inp += k;
         if (_ipindex == _ipsize) _ipindex = 0;
+        if (_timer) t = _timer->lap (Dsptimer::ST_RESAMP, t);
 
         // Process available samples.
         dr = _ratio;
@@ -210,102 +609,74 @@ int Retuner::process (int nfram, float *inp, float *out)
         if (_xfade)
         {
             // Interpolate and crossfade.
-            while (k--)
-            {
-                i = (int) r1;
-                u1 = cubic (_ipbuff + i, r1 - i);
-                i = (int) r2;
-                u2 = cubic (_ipbuff + i, r2 - i);
-                v = _xffunc [fi++];
-                *out++ = (1 - v) * u1 + v * u2;
-                r1 += dr;
-                if (r1 >= _ipsize) r1 -= _ipsize;
-                r2 += dr;
-                if (r2 >= _ipsize) r2 -= _ipsize;
-            }
+            interp_xfade (_ipbuff, _ipsize, &r1, &r2, dr, _xffunc + fi, out, k);
         }
         else
         {
             // Interpolation only.
-            fi += k;
-            while (k--)
+            interp_cubic (_ipbuff, _ipsize, &r1, dr, out, k);
+        }
+        // Same for the harmony voices.
+        for (v = 0, V = _voice; v < _nvoice; v++, V++)
+        {
+            dr = V->_ratio;
+            if (_upsamp) dr *= 2;
+            if (V->_xfade)
             {
-                i = (int) r1;
-                *out++ = cubic (_ipbuff + i, r1 - i);
-                r1 += dr;
-                if (r1 >= _ipsize) r1 -= _ipsize;
+                interp_xfade (_ipbuff, _ipsize, &V->_rindex1, &V->_rindex2, dr, _xffunc + fi, vout [v] + fo, k);
+            }
+            else
+            {
+                interp_cubic (_ipbuff, _ipsize, &V->_rindex1, dr, vout [v] + fo, k);
             }
         }
+        out += k;
+        fo += k;
+        fi += k;
+        if (_timer) t = _timer->lap (Dsptimer::ST_INTERP, t);
  
         // If at end of fragment check for jump.
         if (fi == _frsize) 
         {
             fi = 0;
-            // Estimate the pitch every 4th fragment.
-            if (++_frcount == 4)
+            // Apply new or changing parameters.
+            checkparam ();
+            // Estimate the pitch every '_ehop' fragments, which
+            // is '_nhop' unless freewheeling.
+            if (++_frcount == _ehop)
             {
                 _frcount = 0;
-                findcycle ();
-                if (_cycle)
-                {
-                    // If the pitch estimate succeeds, find the
-                    // nearest note and required resampling ratio.
-                    _count = 0;
-                    finderror ();
-                }
-                else if (++_count > 5)
+                if (_worker)
                 {
-                    // If the pitch estimate fails, the current
-                    // ratio is kept for 5 fragments. After that
-                    // the signal is considered unvoiced and the
-                    // pitch error is reset.
-                    _count = 5;
-                    _cycle = _frsize;
-                    _error = 0;
+                    // Use the result from the worker thread, if any.
+                    // While freewheeling wait for it.
+                    if (_fwheel) syncycle ();
+                    if (_fwheel || asyncycle ()) update (fo);
                 }
-                else if (_count == 2)
+                else if (! _spread || _fwheel)
                 {
-                    // Bias is removed after two unvoiced fragments.
-                    _lastnote = -1;
+                    snapshot (_snap [0]);
+                    _cycle = _adecim * _pitchdet->findcycle (_snap [0]);
+                    update (fo);
                 }
-                
-                _ratio = powf (2.0f, _corroffs / 12.0f - _error * _corrgain);
             }
+            if (_spread && ! _worker && ! _fwheel) spreadcycle (fo);
+            if (_timer) t = _timer->lap (Dsptimer::ST_ESTIM, t);
+
+            // Harmony voice ratios follow the main one.
+            if (_nvoice) voiceratio ();
 
             // If the previous fragment was crossfading,
             // the end of the new fragment that was faded
             // in becomes the current read position.
             if (_xfade) r1 = r2;
-
-            // A jump must correspond to an integer number
-            // of pitch periods, and to avoid reading outside
-            // the circular input buffer limits it must be at
-            // least one fragment size.
-            dr = _cycle * (int)(ceilf (_frsize / _cycle));
-            dp = dr / _frsize;
-            ph = r1 - _ipindex;
-            if (ph < 0) ph += _ipsize;
-            if (_upsamp)
-            {
-                ph /= 2;
-                dr *= 2;
-            }
-            ph = ph / _frsize + 2 * _ratio - 10;
-            if (ph > 0.5f)
+            _xfade = jump (r1, &r2, _ratio);
+            if (_xfade) _jumped = true;
+            for (v = 0, V = _voice; v < _nvoice; v++, V++)
             {
-                // Jump back by 'dr' frames and crossfade.
-                _xfade = true;
-                r2 = r1 - dr;
-                if (r2 < 0) r2 += _ipsize;
+                if (V->_xfade) V->_rindex1 = V->_rindex2;
+                V->_xfade = jump (V->_rindex1, &V->_rindex2, V->_ratio);
             }
-            else if (ph + dp < 0.5f)
-            {
-                // Jump forward by 'dr' frames and crossfade.
-                _xfade = true;
-                r2 = r1 + dr;
-                if (r2 >= _ipsize) r2 -= _ipsize;
-            }
-            else _xfade = false;
         }
     }
 
@@ -318,68 +689,253 @@ int Retuner::process (int nfram, float *inp, float *out)
 }
 
 
-void Retuner::findcycle (void)
+void Retuner::update (int frame)
 {
-    int    d, h, i, j, k;
-    float  f, m, t, x, y, z;
+    int    f, h;
+    Estim  *E;
 
-    d = _upsamp ? 2 : 1;
-    h = _fftlen / 2;
-    j = _ipindex;
-    k = _ipsize - 1;
-    for (i = 0; i < _fftlen; i++)
+    // The hold counts below are for one estimate per '_nhop'
+    // fragments, see set_freewheel().
+    h = _nhop / _ehop;
+    if (_cycle)
     {
-        _fftTdata [i] = _fftTwind [i] * _ipbuff [j & k];
-        j += d;
+        // If the pitch estimate succeeds, find the
+        // nearest note and required resampling ratio.
+        _count = 0;
+        _voiced = true;
+        finderror ();
+    }
+    else if (++_count > 5 * h)
+    {
+        // If the pitch estimate fails, the current
+        // ratio is kept for 5 fragments. After that
+        // the signal is considered unvoiced and the
+        // pitch error is reset.
+        _count = 5 * h;
+        _voiced = false;
+        _cycle = _frsize;
+        _error = 0;
+        _midinote = -1;
+    }
+    else if (_count == 2 * h)
+    {
+        // Bias is removed after two unvoiced fragments.
+        _lastnote = -1;
+    }
+    
+    _ratio = powf (2.0f, _corroffs / 12.0f - _error * _corrgain);
+
+    // Log the estimate for this process() call.
+    if (_nestim < NESTIM)
+    {
+        E = _estim + _nestim++;
+        E->_frame = frame;
+        E->_note = _midinote;
+        if (_count)
+        {
+            E->_freq = 0;
+            E->_bend = 0;
+        }
+        else
+        {
+            E->_freq = _fsamp / _cycle;
+            E->_bend = 12 * _pitch - (_midinote - 69);
+        }
+    }
+    else _nlost++;
+
+    if (_telemetry)
+    {
+        f = 0;
+        if (_voiced) f |= Telemetry::F_VOICED;
+        if (! _count && _notemask) f |= Telemetry::F_CORR;
+        if (_jumped) f |= Telemetry::F_JUMP;
+        _telemetry->push (_count ? 0 : _cycle, 12.0f * _error, _ratio, _midinote, f);
+        _jumped = false;
+    }
+}
+
+
+bool Retuner::jump (float r1, float *r2, float ratio)
+{
+    float  ph, dp, dr;
+
+    // A jump must correspond to an integer number
+    // of pitch periods, and to avoid reading outside
+    // the circular input buffer limits it must be at
+    // least one fragment size.
+    dr = _cycle * (int)(ceilf (_frsize / _cycle));
+    dp = dr / _frsize;
+    ph = r1 - _ipindex;
+    if (ph < 0) ph += _ipsize;
+    if (_upsamp)
+    {
+        ph /= 2;
+        dr *= 2;
+    }
+    ph = ph / _frsize + 2 * ratio - _jumpref;
+    if (ph > 0.5f)
+    {
+        // Jump back by 'dr' frames and crossfade.
+        *r2 = r1 - dr;
+        if (*r2 < 0) *r2 += _ipsize;
+        return true;
+    }
+    if (ph + dp < 0.5f)
+    {
+        // Jump forward by 'dr' frames and crossfade.
+        *r2 = r1 + dr;
+        if (*r2 >= _ipsize) *r2 -= _ipsize;
+        return true;
     }
-    fftwf_execute_dft_r2c (_fwdplan, _fftTdata, _fftFdata);    
-    f = _fsamp / (_fftlen * 2.5e3f);
-    for (i = 0; i < h; i++)
-    {
-        x = _fftFdata [i][0];
-        y = _fftFdata [i][1];
-        m = i * f;
-        _fftFdata [i][0] = (x * x + y * y) / (1 + m * m);
-        _fftFdata [i][1] = 0;
-    }
-    _fftFdata [h][0] = 0;
-    _fftFdata [h][1] = 0;
-    fftwf_execute_dft_c2r (_invplan, _fftFdata, _fftTdata);    
-    t = _fftTdata [0] + 0.1f;
-    for (i = 0; i < h; i++) _fftTdata [i] /= (t * _fftWcorr [i]);
-    x = _fftTdata [0];
-    for (i = 4; i < _ifmax; i += 4)
-    {
-        y = _fftTdata [i];
-        if (y > x) break;
-        x = y;
-    }
-    i -= 4;
-    _cycle = 0;
-    if (i >= _ifmax) return;
-    if (i <  _ifmin) i = _ifmin;
-    x = _fftTdata [--i];
-    y = _fftTdata [++i];
-    m = 0;
-    j = 0;
-    while (i <= _ifmax)
-    {
-        t = y * _fftWcorr [i];
-        z = _fftTdata [++i];
-        if ((t >  m) && (y >= x) && (y >= z) && (y > 0.8f))
+    return false;
+}
+
+
+void Retuner::voiceratio (void)
+{
+    int    v;
+    float  r;
+    Voice  *V;
+
+    for (v = 0, V = _voice; v < _nvoice; v++, V++)
+    {
+        if (V->_note >= 0)
         {
-            j = i - 1;
-            m = t;
+            // Ratio from the input pitch to the note. If there
+            // is no pitch the last ratio is kept.
+            if (! _voiced || ! _cycle) continue;
+            r = _refpitch * powf (2.0f, (V->_note - 69) / 12.0f) * _cycle / _fsamp;
         }
-        x = y;
-        y = z;
+        else r = _ratio * powf (2.0f, _interval [v] / 12.0f);
+        // The jump logic can't handle more than an octave.
+        if (r < 0.5f) r = 0.5f;
+        if (r > 2.0f) r = 2.0f;
+        V->_ratio = r;
     }
-    if (j)
+}
+
+
+void Retuner::spreadcycle (int frame)
+{
+    int    n, k;
+    float  c;
+
+    // Take a snapshot at the estimation point, then run as many
+    // stages in each fragment as required to have all of them
+    // done before the next one. Any idle fragments are at the end.
+    if (_frcount == 0)
     {
-        x = _fftTdata [j - 1];
-        y = _fftTdata [j];
-        z = _fftTdata [j + 1];
-        _cycle = j + 0.5f * (x - z) / (z - 2 * y + x - 1e-9f);
+        snapshot (_snap [0]);
+        _stage = 0;
+    }
+    else if (_stage < 0) return;
+    n = _pitchdet->nstage ();
+    k = ((_frcount + 1) * n + _nhop - 1) / _nhop;
+    if (_stage >= k) return;
+    do c = _pitchdet->stage (_stage, _snap [0]);
+    while (++_stage < k);
+    if (_stage == n)
+    {
+        _cycle = _adecim * c;
+        update (frame);
+    }
+}
+
+
+bool Retuner::asyncycle (void)
+{
+    int   n;
+    bool  r;
+
+    // Take the most recent result if there is a new one.
+    r = false;
+    n = _nres.load (std::memory_order_acquire);
+    if (n != _nused)
+    {
+        _cycle = _wcycle [(n - 1) % NSLOT];
+        _nused = n;
+        r = true;
+    }
+    // Send a new snapshot unless both slots are still in use.
+    if (_nsnap - n < NSLOT)
+    {
+        snapshot (_snap [_nsnap % NSLOT]);
+        _nsnap++;
+        sem_post (&_trig);
+    }
+    return r;
+}
+
+
+void Retuner::syncycle (void)
+{
+    // The Pitchdet is used only by the worker thread, so while
+    // freewheeling the estimate is made there as well, and waited
+    // for. Any snapshots still pending are done first, so the slot
+    // written here is not in use, and none are left when the
+    // freewheeling ends. The semaphore can have posts left from
+    // results that were not waited for, so check the count.
+    while (_nres.load (std::memory_order_acquire) != _nsnap) sem_wait (&_done);
+    snapshot (_snap [_nsnap % NSLOT]);
+    _nsnap++;
+    sem_post (&_trig);
+    while (_nres.load (std::memory_order_acquire) != _nsnap) sem_wait (&_done);
+    _cycle = _wcycle [(_nsnap - 1) % NSLOT];
+    _nused = _nsnap;
+}
+
+
+void Retuner::decimate (int nfram, float *inp)
+{
+    _decimator.inp_count = nfram;
+    _decimator.inp_data = inp;
+    while (_decimator.inp_count)
+    {
+        _decimator.out_count = _apsize - _apindex;
+        _decimator.out_data = _apbuff + _apindex;
+        _decimator.process ();
+        _apindex = _apsize - _decimator.out_count;
+        if (_apindex == _apsize) _apindex = 0;
+    }
+}
+
+
+void Retuner::snapshot (float *p)
+{
+    (this->*_snapfn) (p);
+}
+
+
+// Fixed size versions for the profile FFT lengths, see
+// Pitchdet_fft::kernel().
+
+template <int N> void Retuner::snapshot_n (float *p)
+{
+    int    d, i, j, k, n;
+    float  *q;
+
+    // Copy the analysis window from the decimated
+    // or upsampled input buffer.
+    n = N ? N : _fftlen;
+    if (_apbuff)
+    {
+        q = _apbuff;
+        d = 1;
+        j = _apindex + _apsize - n;
+        k = _apsize - 1;
+    }
+    else
+    {
+        q = _ipbuff;
+        d = _upsamp ? 2 : 1;
+        j = _ipindex + _ipsize - d * n;
+        k = _ipsize - 1;
+    }
+    for (i = 0; i < n; i++)
+    {
+        p [i] = q [j & k];
+        j += d;
     }
 }
 
@@ -389,14 +945,18 @@ void Retuner::finderror (void)
     int    i, m, im;
     float  a, am, d, dm, f;
 
+    // Without any notes selected there is no correction, but
+    // the nearest note is still reported, see get_estim().
+    f = log2f (_fsamp / (_cycle * _refpitch));
+    _pitch = f;
     if (!_notemask)
     {
         _error = 0;
         _lastnote = -1;
+        _midinote = 69 + (int) floorf (12 * f + 0.5f);
         return;
     }
 
-    f = log2f (_fsamp / (_cycle * _refpitch));
     dm = 0;
     am = 1;
     im = -1;
@@ -419,25 +979,15 @@ void Retuner::finderror (void)
     
     if (_lastnote == im)
     {
-        _error += _corrfilt * (dm - _error);
+        // The filter constant is for one estimate per '_nhop'
+        // fragments, see set_freewheel().
+        _error += _corrfilt * _ehop / _nhop * (dm - _error);
     }
     else
     {
         _error = dm;
         _lastnote = im;
     }
-
-    // For display only.
-    _notebits |= 1 << im;
+    _midinote = 69 + (int) floorf (12 * (f - dm) + 0.5f);
 }
 
-
-float Retuner::cubic (float *v, float a)
-{
-    float b, c;
-
-    b = 1 - a;
-    c = a * b;
-    return (1.0f + 1.5f * c) * (v[1] * b + v[2] * a)
-            - 0.5f * c * (v[0] * b + v[1] + v[2] + v[3] * a);
-}
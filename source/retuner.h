@@ -23,105 +23,332 @@
 #define __RETUNER_H
 
 
-#include <fftw3.h>
+#include <atomic>
+#include <pthread.h>
+#include <semaphore.h>
 #include <zita-resampler.h>
+#include "pitchdet.h"
+#include "dsptimer.h"
+#include "telemetry.h"
+#include "arena.h"
 
 
 class Retuner
 {
 public:
 
-    Retuner (int fsamp);
+    // Processing profiles. These set the fragment size, FFT length,
+    // estimation interval, lowest detected frequency, input buffer
+    // size and read delay, see retuner.cc.
+    enum { PROF_NORMAL, PROF_LOWLAT, PROF_ACCURATE, NPROF };
+
+    // While freewheeling there is an estimate for every fragment, so
+    // a JACK period of 8192 frames with the 64 frame fragments of the
+    // low latency profile has 128 of them. Any more are dropped, and
+    // counted, see get_estim().
+    enum { MAXVOICE = 4, NESTIM = 128 };
+
+    Retuner (int fsamp, int pdtype = Pitchdet::FFT, int profile = PROF_NORMAL);
     ~Retuner (void);
 
-    int process (int nfram, float *inp, float *out);
+    // If harmony voices are used, 'vout' must point to one output
+    // buffer for each of them.
+    int process (int nfram, float *inp, float *out, float *vout [] = 0);
+
+    // Delay from input to output in frames, for a ratio of one.
+    // The actual delay varies by about a pitch period around it.
+    int latency (void) const { return _rdelay * _frsize; }
+
+    static const char *profile_name (int profile);
+    static int profile_find (const char *name);
+
+    // Run the pitch estimation in a separate thread with the given
+    // scheduling policy and priority. Must be called before the
+    // first call to process(). Returns 0 on success.
+    //
+    // The audio thread then only copies the analysis window into
+    // one of two slots and wakes up the worker. The result is used
+    // at the next estimation point, i.e. one estimation interval
+    // later than in the default synchronous mode (10.7 ms at 48 kHz
+    // for the normal profile). If the worker is late the current
+    // correction is kept. At most two snapshots are queued, so a
+    // result used by the audio thread is never older than two
+    // estimation periods.
+    int start_worker (int policy, int priority);
+
+    // Spread the pitch estimation over the fragments between two
+    // estimation points, so the CPU load per fragment is more even.
+    // The result is used as soon as the last part is done, two or
+    // three fragments later than in the default mode. Has no effect
+    // if the worker thread is used. Must be called before the first
+    // call to process().
+    void set_spread (bool v) { _spread = v; }
+
+    // Record the time used by the processing stages, see dsptimer.h.
+    // Must be called before the first call to process(), or with the
+    // process thread stopped.
+    void set_timer (Dsptimer *timer) { _timer = timer; }
+
+    // Add a record to 'T' for every pitch estimate, see telemetry.h.
+    // Must be called before the first call to process(), or with the
+    // process thread stopped.
+    void set_telemetry (Telemetry *T) { _telemetry = T; }
+
+    // See Pitchdet_fft::start_planner().
+    int start_planner (void) { return _pitchdet->start_planner (); }
 
-    void set_refpitch (float v)
+    // These can be used from any non-realtime thread. The values are
+    // passed to the audio thread as a complete set, which is taken at
+    // the start of the next fragment.
+    void set_refpitch (float v);
+    void set_notebias (float v);
+    void set_corrfilt (float v);
+    void set_corrgain (float v);
+    void set_corroffs (float v);
+
+    // Time constant in seconds for changes of the tuning, correction
+    // and offset parameters. Zero (the default) disables smoothing.
+    void set_smoothing (float v);
+
+    // Process thread versions of the first five setters. For each of
+    // these parameters the value that was set last, by either way, is
+    // used. As for the others the new value is taken at the end of the
+    // current fragment.
+    enum { PAR_REFPITCH, PAR_NOTEBIAS, PAR_CORRFILT, PAR_CORRGAIN, PAR_CORROFFS, NPAR };
+    void set_param (int k, float v);
+
+    // Take all parameters set by the functions above from 'R', which
+    // may run at another sample rate. The new values are used from
+    // the start, without smoothing. Must be called before the first
+    // call to process().
+    void copy_param (Retuner *R);
+
+    // Process thread, after copy_param (R) and before the first call
+    // to process(). Take the values set on 'R' by set_param() that
+    // were not replaced by the setters since, and continue the
+    // smoothing from the current values of 'R'.
+    void take_param (Retuner *R);
+
+    // Harmony voice interval in semitones, relative to the corrected
+    // main output, in the range -12..12.
+    void set_interval (int v, float semit);
+
+    // Number of harmony voices, 0..MAXVOICE. Each voice is another read
+    // position in the same input buffer, using the same pitch estimate.
+    // Must be called before the first call to process().
+    void set_voices (int n);
+
+    // Unlike the others these must be called from the process thread.
+    void set_notemask (int k)
     {
-        _refpitch = v;
+        _notemask = k;
     }
 
-    void set_notebias (float v)
+    // While freewheeling a pitch estimate is made at the end of every
+    // fragment instead of every estimation interval, and waited for,
+    // so the result does not depend on the timing of a worker thread.
+    // The correction filter and the unvoiced hold time are scaled to
+    // keep the same time constants. This is too expensive in real
+    // time, but makes offline renders track the pitch more closely.
+    void set_freewheel (bool v)
     {
-        _notebias = v / 13.0f;
+        if (v == _fwheel) return;
+        _fwheel = v;
+        _ehop = v ? 1 : _nhop;
+        _frcount = 0;
+        // A spread estimate in progress uses a snapshot that
+        // may have been overwritten, so start a new one.
+        _stage = -1;
     }
 
-    void set_corrfilt (float v)
+    // Make voice 'v' sing MIDI note 'n' instead of its interval,
+    // or use the interval again if 'n' is negative.
+    void set_voicenote (int v, int n)
     {
-        _corrfilt = (4 * _frsize) / (v * _fsamp);
+        _voice [v]._note = n;
     }
 
-    void set_corrgain (float v)
+
+    float get_error (void)
     {
-        _corrgain = v;
+        return 12.0f * _error;
     }
 
-    void set_corroffs (float v)
+    // Result of a pitch estimate. The note is the one the output is
+    // corrected to, or the nearest one if the note mask is empty. It
+    // is kept while the estimate fails for a short time, and is -1
+    // when the input is unvoiced. The bend is the distance of the
+    // input from the note in semitones. Both frequency and bend are
+    // zero if this estimate failed.
+    class Estim
     {
-        _corroffs = v;
+    public:
+
+        int     _frame;   // Offset in the process() call
+        int     _note;    // MIDI note number
+        float   _freq;    // Input frequency in Hz
+        float   _bend;    // Input pitch relative to note
+    };
+
+    // The estimates made during the last call to process(), in order,
+    // at most NESTIM of them. Must be called from the process thread.
+    int get_estim (const Estim **E) const
+    {
+        *E = _estim;
+        return _nestim;
     }
 
-    void set_notemask (int k)
+    // The number of estimates made during the last call to process()
+    // that did not fit in NESTIM.
+    int get_nlost (void) const
     {
-        _notemask = k;
+        return _nlost;
     }
-   
-    int get_noteset (void)
+
+
+private:
+
+    friend class Retuner_bench;   // zita-at1-bench
+
+    enum { NSLOT = 2, NEWPAR = 4 };
+
+    // Parameter set passed from the setters to the audio thread.
+    // Values are stored in the form used by the audio thread.
+    class Param
     {
-        int k;
+    public:
 
-        k = _notebits;
-        _notebits = 0;
-        return k;
-    }
+        float   _refpitch;
+        float   _notebias;
+        float   _corrfilt;
+        float   _corrgain;
+        float   _corroffs;
+        float   _smooth;
+        float   _interval [MAXVOICE];
+        int     _serial [NPAR];  // Incremented by each setter
+    };
 
-    float get_error (void)
+    // Read position and ratio of a harmony voice.
+    class Voice
     {
-        return 12.0f * _error;
-    }
+    public:
 
+        float   _ratio;
+        float   _rindex1;
+        float   _rindex2;
+        bool    _xfade;
+        int     _note;
+    };
 
-private:
+    void  sendparam (void);
+    void  checkparam (void);
 
-    void  findcycle (void);
+    void  decimate (int nfram, float *inp);
+    void  snapshot (float *p);
+    template <int N> void snapshot_n (float *p);
     void  finderror (void);
-    float cubic (float *v, float a);
+    void  update (int frame);
+    bool  jump (float r1, float *r2, float ratio);
+    void  voiceratio (void);
+    bool  asyncycle (void);
+    void  syncycle (void);
+    void  spreadcycle (int frame);
+    void  thr_main (void);
 
-    int              _fsamp;
-    int              _ifmin;
-    int              _ifmax;
-    bool             _upsamp;
-    int              _fftlen;
+    static void *static_main (void *arg);
+
+    // State used for every sample or fragment, kept together
+    // and starting on a cache line.
+    alignas (Arena::ALIGN)
+    float           *_ipbuff;
+    float           *_xffunc;
+    float           *_apbuff;
+    Dsptimer        *_timer;
     int              _ipsize;
-    int              _frsize;
     int              _ipindex;
+    int              _frsize;
     int              _frindex;
     int              _frcount;
+    int              _nhop;
+    int              _ehop;
+    int              _jumpref;
+    int              _adecim;
+    int              _apsize;
+    int              _apindex;
+    float            _ratio;
+    float            _cycle;
+    float            _rindex1;
+    float            _rindex2;
+    bool             _upsamp;
+    bool             _xfade;
+    bool             _spread;
+    bool             _worker;
+    bool             _fwheel;
+    int              _stage;
+    int              _nvoice;
+    Voice            _voice [MAXVOICE];
+    Resampler        _resampler;
+    Resampler        _decimator;
+
+    // Used once per estimate.
     float            _refpitch;
     float            _notebias;
     float            _corrfilt; 
     float            _corrgain;
     float            _corroffs;
     int              _notemask;
-    int              _notebits;
+    bool             _jumped;
+    Telemetry       *_telemetry;
     int              _lastnote;
     int              _count;
-    float            _cycle;
+    bool             _voiced;
+    float            _pitch;
+    int              _midinote;
+    int              _nestim;
+    int              _nlost;
+    Estim            _estim [NESTIM];
+    float            _interval [MAXVOICE];
+    Param            _target;
+    float            _setval [NPAR];
+    int              _setmask;
     float            _error;
-    float            _ratio;
     float            _phase;
-    bool             _xfade;
-    float            _rindex1;
-    float            _rindex2;
-    float           *_ipbuff;
-    float           *_xffunc;
-    float           *_fftTwind;
-    float           *_fftWcorr;
-    float           *_fftTdata;
-    fftwf_complex   *_fftFdata;
-    fftwf_plan       _fwdplan;
-    fftwf_plan       _invplan;
-    Resampler        _resampler;
+    float           *_snap [NSLOT];
+    Pitchdet        *_pitchdet;
+    void  (Retuner::*_snapfn) (float *p);
+
+    // Configuration, not used by process().
+    int              _fsamp;
+    int              _ifmin;
+    int              _ifmax;
+    int              _fftlen;
+    int              _asamp;
+    int              _rdelay;
+    Arena           *_arena;
+
+    // Worker thread state.
+    alignas (Arena::ALIGN)
+    volatile bool    _stop;
+    pthread_t        _thread;
+    sem_t            _trig;
+    sem_t            _done;
+    int              _nsnap;
+    int              _nused;
+    std::atomic<int> _nres;
+    float            _wcycle [NSLOT];
+
+    // Parameter triple buffer. The writer owns '_param [_pwr]', the
+    // audio thread '_param [_prd]', the third one is in '_pmid'.
+    alignas (Arena::ALIGN)
+    pthread_mutex_t  _pmutex;
+    Param            _pset;
+    float            _tfilt;
+    float            _tsmooth;
+    Param            _param [3];
+    int              _pwr;
+    int              _prd;
+    std::atomic<int> _pmid;
+    bool             _pchange;
 };
 
 
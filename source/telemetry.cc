@@ -0,0 +1,110 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2009-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+
+
+#include "telemetry.h"
+
+
+// Never the index of a record in the slot.
+#define INVALID(i) ((i) + 1)
+
+
+Telemetry::Telemetry (void)
+{
+    int i;
+
+    _count = 0;
+    for (i = 0; i < NREC; i++)
+    {
+        _slot [i]._index = INVALID (i);
+        _slot [i]._cycle = 0;
+        _slot [i]._error = 0;
+        _slot [i]._ratio = 1;
+        _slot [i]._note = -1;
+        _slot [i]._flags = 0;
+    }
+}
+
+
+void Telemetry::push (float cycle, float error, float ratio, int note, int flags)
+{
+    uint32_t  n;
+    Slot      *S;
+
+    n = _count.load (std::memory_order_relaxed);
+    S = _slot + n % NREC;
+    S->_index.store (INVALID (n), std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_release);
+    S->_cycle.store (cycle, std::memory_order_relaxed);
+    S->_error.store (error, std::memory_order_relaxed);
+    S->_ratio.store (ratio, std::memory_order_relaxed);
+    S->_note.store (note, std::memory_order_relaxed);
+    S->_flags.store (flags, std::memory_order_relaxed);
+    S->_index.store (n, std::memory_order_release);
+    _count.store (n + 1, std::memory_order_release);
+}
+
+
+bool Telemetry::get (uint32_t p, Record *R) const
+{
+    const Slot  *S;
+
+    // Fails if the slot no longer has record 'p', or if it
+    // was rewritten while being copied.
+    S = _slot + p % NREC;
+    if (S->_index.load (std::memory_order_acquire) != p) return false;
+    R->_index = p;
+    R->_cycle = S->_cycle.load (std::memory_order_relaxed);
+    R->_error = S->_error.load (std::memory_order_relaxed);
+    R->_ratio = S->_ratio.load (std::memory_order_relaxed);
+    R->_note = S->_note.load (std::memory_order_relaxed);
+    R->_flags = S->_flags.load (std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_acquire);
+    return S->_index.load (std::memory_order_relaxed) == p;
+}
+
+
+int Telemetry::read (uint32_t *pos, Record *R, int n, uint32_t *lost) const
+{
+    int       k;
+    uint32_t  c, p;
+
+    c = _count.load (std::memory_order_acquire);
+    p = *pos;
+    if (c - p > NREC)
+    {
+        // Overwritten before we could read them.
+        if (lost) *lost += c - NREC - p;
+        p = c - NREC;
+    }
+    for (k = 0; (k < n) && (p != c); p++)
+    {
+        if (get (p, R))
+        {
+            R++;
+            k++;
+        }
+        else if (lost) *lost += 1;
+    }
+    *pos = p;
+    return k;
+}
@@ -0,0 +1,100 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2009-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+
+#include <stdint.h>
+#include <atomic>
+
+
+// Results of the pitch estimation, one record for each estimate.
+// The process thread adds them using push(). Readers in any thread
+// and in any number each keep their own position and never block
+// the writer: if a reader falls more than NREC records behind, the
+// oldest ones are overwritten and reported as lost. Each slot has a
+// sequence number that is invalid while the slot is being written,
+// so a reader can also detect a record that changed while it was
+// being copied.
+
+
+class Telemetry
+{
+public:
+
+    enum { NREC = 256 };
+
+    // Record flags.
+    enum
+    {
+        F_VOICED = 1,   // The input is considered voiced
+        F_CORR   = 2,   // The note was selected by the note mask
+        F_JUMP   = 4    // There was a jump and crossfade since the previous record
+    };
+
+    class Record
+    {
+    public:
+
+        uint32_t  _index;   // Record number
+        float     _cycle;   // Pitch period in frames, zero if the estimate failed
+        float     _error;   // Filtered pitch error in semitones
+        float     _ratio;   // Resampling ratio of the main output
+        int       _note;    // MIDI note number or -1, see Retuner::Estim
+        int       _flags;
+    };
+
+    Telemetry (void);
+
+    // Process thread only.
+    void push (float cycle, float error, float ratio, int note, int flags);
+
+    // Any thread. A new reader should start at position(). Copies
+    // at most 'n' records starting at '*pos', and returns the number
+    // copied. Records that were overwritten are skipped, and their
+    // number is added to '*lost' if not null.
+    uint32_t position (void) const { return _count.load (std::memory_order_acquire); }
+    int read (uint32_t *pos, Record *R, int n, uint32_t *lost = 0) const;
+
+private:
+
+    bool get (uint32_t p, Record *R) const;
+
+    class Slot
+    {
+    public:
+
+        std::atomic<uint32_t>  _index;
+        std::atomic<float>     _cycle;
+        std::atomic<float>     _error;
+        std::atomic<float>     _ratio;
+        std::atomic<int>       _note;
+        std::atomic<int>       _flags;
+    };
+
+    std::atomic<uint32_t>   _count;
+    Slot                    _slot [NREC];
+};
+
+
+#endif
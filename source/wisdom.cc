@@ -0,0 +1,164 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2009-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "wisdom.h"
+
+
+#define NLOADED 16
+#define MEASURE_TIME 2.0
+
+
+static pthread_mutex_t  mutex = PTHREAD_MUTEX_INITIALIZER;
+static int              loaded [NLOADED];
+static int              nloaded = 0;
+
+
+static int filename (char *name, int size, int fftlen, bool create)
+{
+    const char  *p;
+    int         k;
+
+    if ((p = getenv ("XDG_CACHE_HOME")) && *p)
+    {
+        k = snprintf (name, size, "%s", p);
+    }
+    else if ((p = getenv ("HOME")) && *p)
+    {
+        k = snprintf (name, size, "%s/.cache", p);
+    }
+    else return 1;
+    if (k + 40 > size) return 1;
+    if (create) mkdir (name, 0755);
+    strcat (name, "/zita-at1");
+    if (create) mkdir (name, 0755);
+    sprintf (name + strlen (name), "/fftwf-wisdom-%d", fftlen);
+    return 0;
+}
+
+
+static void load (int fftlen)
+{
+    int   i;
+    char  name [1024];
+
+    // Called with the mutex locked.
+    for (i = 0; i < nloaded; i++)
+    {
+        if (loaded [i] == fftlen) return;
+    }
+    if (nloaded < NLOADED) loaded [nloaded++] = fftlen;
+    if (filename (name, 1024, fftlen, false)) return;
+    fftwf_import_wisdom_from_filename (name);
+}
+
+
+bool wisdom_plans (int fftlen, float *tdata, fftwf_complex *fdata,
+                   fftwf_plan *fwd, fftwf_plan *inv)
+{
+    bool  r;
+
+    pthread_mutex_lock (&mutex);
+    load (fftlen);
+    *fwd = fftwf_plan_dft_r2c_1d (fftlen, tdata, fdata, FFTW_PATIENT | FFTW_WISDOM_ONLY);
+    *inv = fftwf_plan_dft_c2r_1d (fftlen, fdata, tdata, FFTW_PATIENT | FFTW_WISDOM_ONLY);
+    r = *fwd && *inv;
+    if (! r)
+    {
+        if (*fwd) fftwf_destroy_plan (*fwd);
+        if (*inv) fftwf_destroy_plan (*inv);
+        *fwd = fftwf_plan_dft_r2c_1d (fftlen, tdata, fdata, FFTW_ESTIMATE);
+        *inv = fftwf_plan_dft_c2r_1d (fftlen, fdata, tdata, FFTW_ESTIMATE);
+    }
+    pthread_mutex_unlock (&mutex);
+    return r;
+}
+
+
+static fftwf_plan measure (int fftlen, float *tdata, fftwf_complex *fdata, bool inv)
+{
+    fftwf_plan  plan;
+
+    // Other threads wait for the mutex while this runs, so limit
+    // the time. If the limit is reached the best plan found so far
+    // is returned. Planning overwrites the arrays.
+    pthread_mutex_lock (&mutex);
+    fftwf_set_timelimit (MEASURE_TIME);
+    if (inv) plan = fftwf_plan_dft_c2r_1d (fftlen, fdata, tdata, FFTW_PATIENT);
+    else     plan = fftwf_plan_dft_r2c_1d (fftlen, tdata, fdata, FFTW_PATIENT);
+    fftwf_set_timelimit (FFTW_NO_TIMELIMIT);
+    pthread_mutex_unlock (&mutex);
+    return plan;
+}
+
+
+int wisdom_measure (int fftlen, float *tdata, fftwf_complex *fdata,
+                    fftwf_plan *fwd, fftwf_plan *inv, const volatile bool *stop)
+{
+    int   r;
+    char  name [1024], temp [1040];
+
+    // Nothing to do if another thread has already measured
+    // this length.
+    if (wisdom_plans (fftlen, tdata, fdata, fwd, inv)) return 0;
+    wisdom_destroy (*fwd);
+    wisdom_destroy (*inv);
+    *fwd = *inv = 0;
+
+    // The plans are measured one at a time, and not at all
+    // once '*stop' is set.
+    if (! *stop) *fwd = measure (fftlen, tdata, fdata, false);
+    if (! *stop) *inv = measure (fftlen, tdata, fdata, true);
+    if (!*fwd || !*inv)
+    {
+        if (*fwd) wisdom_destroy (*fwd);
+        if (*inv) wisdom_destroy (*inv);
+        return 1;
+    }
+
+    // Write to a temporary file and rename, so other instances
+    // never see a partial file.
+    r = 1;
+    if (! filename (name, 1024, fftlen, true))
+    {
+        snprintf (temp, 1040, "%s.%d", name, getpid ());
+        pthread_mutex_lock (&mutex);
+        r = fftwf_export_wisdom_to_filename (temp) ? 0 : 1;
+        pthread_mutex_unlock (&mutex);
+        if (! r && rename (temp, name)) r = 1;
+        if (r) unlink (temp);
+    }
+    if (r) fprintf (stderr, "Warning: can't save FFTW wisdom.\n");
+    return 0;
+}
+
+
+void wisdom_destroy (fftwf_plan plan)
+{
+    pthread_mutex_lock (&mutex);
+    fftwf_destroy_plan (plan);
+    pthread_mutex_unlock (&mutex);
+}
@@ -0,0 +1,56 @@
+// -----------------------------------------------------------------------
+//
+//  Copyright (C) 2009-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// -----------------------------------------------------------------------
+
+
+#ifndef __WISDOM_H
+#define __WISDOM_H
+
+
+#include <fftw3.h>
+
+
+// FFTW wisdom is kept per FFT length in the user's cache directory,
+// $XDG_CACHE_HOME/zita-at1 or $HOME/.cache/zita-at1. The FFTW planner
+// is not thread safe, so all plans must be created and destroyed
+// using these functions.
+
+
+// Create the forward (r2c) and inverse (c2r) plans for 'fftlen'.
+// The file for this length is loaded on first use. If it contains
+// measured plans these are used and the return value is true, else
+// the plans are made with FFTW_ESTIMATE and the return value is false.
+// This never takes more than a few milliseconds.
+extern bool wisdom_plans (int fftlen, float *tdata, fftwf_complex *fdata,
+                          fftwf_plan *fwd, fftwf_plan *inv);
+
+// Measure the best plans for 'fftlen' using FFTW_PATIENT, save them
+// and return them in 'fwd' and 'inv'. This can take a few seconds and
+// should be called from a low priority thread. The other functions
+// wait while a plan is measured, at most two seconds for each of the
+// two plans. Once '*stop' is set no new measurement is started.
+// If the wisdom for 'fftlen' already exists nothing is measured. The
+// plans are returned even if they can't be saved. Returns 0 on success.
+extern int wisdom_measure (int fftlen, float *tdata, fftwf_complex *fdata,
+                           fftwf_plan *fwd, fftwf_plan *inv, const volatile bool *stop);
+
+extern void wisdom_destroy (fftwf_plan plan);
+
+
+#endif
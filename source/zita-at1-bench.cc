@@ -0,0 +1,398 @@
+// ----------------------------------------------------------------------
+//
+//  Copyright (C) 2010-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// ----------------------------------------------------------------------
+
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include "retuner.h"
+#include "pitchdet.h"
+#include "interp.h"
+
+
+#define PROGNAME "zita-at1-bench"
+
+
+static int    rates [] = { 44100, 48000, 96000, 192000, 0 };
+static int    fsamp = 0;
+static float  seconds = 2.0f;
+static int    ncalls = 2000;
+
+
+static void help (void)
+{
+    fprintf (stderr, "\n%s-%s\n\n", PROGNAME, VERSION);
+    fprintf (stderr, "  (C) 2010-2011 Fons Adriaensen  <fons@linuxaudio.org>\n\n");
+    fprintf (stderr, "Usage: %s <options>\n\n", PROGNAME);
+    fprintf (stderr, "Options:\n");
+    fprintf (stderr, "  -h              Display this text\n");
+    fprintf (stderr, "  -r <rate>       Only this sample rate [44100, 48000, 96000, 192000]\n");
+    fprintf (stderr, "  -t <seconds>    Audio length per process() test [2.0]\n");
+    fprintf (stderr, "  -n <count>      Number of calls for other tests [2000]\n");
+    exit (1);
+}
+
+
+static void procoptions (int ac, char *av [])
+{
+    int k;
+
+    while ((k = getopt (ac, av, "hr:t:n:")) != -1)
+    {
+        switch (k)
+        {
+        case 'h': help ();
+        case 'r': fsamp = atoi (optarg); break;
+        case 't': seconds = atof (optarg); break;
+        case 'n': ncalls = atoi (optarg); break;
+        default: help ();
+        }
+    }
+    if (optind != ac) help ();
+    if (fsamp && ((fsamp < 22050) || (fsamp > 384000)))
+    {
+        fprintf (stderr, "Sample rate must be in the range 22050..384000.\n");
+        exit (1);
+    }
+    if (seconds < 0.1f) seconds = 0.1f;
+    if (ncalls < 1) ncalls = 1;
+}
+
+
+static double timediff (struct timespec *t0, struct timespec *t1)
+{
+    return (t1->tv_sec - t0->tv_sec) + 1e-9 * (t1->tv_nsec - t0->tv_nsec);
+}
+
+
+static float urand (void)
+{
+    return rand () / (float) RAND_MAX;
+}
+
+
+// Harmonic tone with random harmonic amplitudes and phases, plus
+// white noise at -30 dB relative to the tone. If 'vibr' is not zero
+// the frequency is modulated by that fraction at 5 Hz.
+
+static void gentone (float *p, int n, int fs, float freq, float vibr, int seed)
+{
+    int     i, h, nh;
+    float   a [16], f [16], s, g;
+    double  ph;
+
+    srand (seed);
+    nh = (int)(0.4f * fs / freq);
+    if (nh > 16) nh = 16;
+    for (h = 0; h < nh; h++)
+    {
+        a [h] = urand () / (h + 1);
+        f [h] = 2 * M_PI * urand ();
+    }
+    a [0] = 1.0f;
+    memset (p, 0, n * sizeof (float));
+    ph = 0;
+    for (i = 0; i < n; i++)
+    {
+        ph += 2 * M_PI * freq * (1 + vibr * sin (2 * M_PI * 5 * i / fs)) / fs;
+        for (h = 0; h < nh; h++) p [i] += a [h] * sinf ((h + 1) * ph + f [h]);
+    }
+    for (i = 0, s = 0; i < n; i++) s += p [i] * p [i];
+    g = 0.0316f * sqrtf (s / n) * sqrtf (12.0f);
+    for (i = 0; i < n; i++) p [i] += g * (urand () - 0.5f);
+}
+
+
+static void gennoise (float *p, int n, int seed)
+{
+    int i;
+
+    srand (seed);
+    for (i = 0; i < n; i++) p [i] = urand () - 0.5f;
+}
+
+
+// Access to the private parts of the Retuner.
+
+class Retuner_bench
+{
+public:
+
+    static void set_cycle (Retuner *R, float v) { R->_cycle = v; }
+    static void finderror (Retuner *R) { R->finderror (); }
+};
+
+
+// Retuner::process(), voiced and unvoiced input, for all JACK
+// period sizes. The worst case is the slowest single call, and
+// includes the pitch estimation done every few fragments. The
+// last two columns are with the estimation spread over them.
+
+static void bench_process (int fs)
+{
+    Retuner          *R;
+    float            *inp, *out;
+    int               b, i, k, n, v;
+    double            t, tsum, tmax;
+    struct timespec   t0, t1;
+
+    n = (int)(seconds * fs);
+    inp = new float [n];
+    out = new float [4096];
+    printf ("\nRetuner::process, %d Hz, ns/sample\n", fs);
+    printf ("period  voiced mean     worst  unvoiced mean     worst    spread mean     worst\n");
+    for (b = 16; b <= 4096; b *= 2)
+    {
+        printf ("%6d", b);
+        // Voiced, unvoiced, and voiced with the analysis spread.
+        for (v = 0; v < 3; v++)
+        {
+            if (v != 1) gentone (inp, n, fs, 233.0f, 0.01f, 1);
+            else gennoise (inp, n, 2);
+            R = new Retuner (fs);
+            R->set_spread (v == 2);
+            R->set_notemask (0x0A5);
+            // Warm up caches and let the estimation settle.
+            for (i = 0; i < n / 4; i += b) R->process (b, inp + i, out);
+            tsum = tmax = 0;
+            for (i = 0; i + b <= n; i += b)
+            {
+                clock_gettime (CLOCK_MONOTONIC, &t0);
+                R->process (b, inp + i, out);
+                clock_gettime (CLOCK_MONOTONIC, &t1);
+                t = timediff (&t0, &t1);
+                tsum += t;
+                if (t > tmax) tmax = t;
+            }
+            k = i;
+            printf ("%13.1lf %9.1lf", 1e9 * tsum / k, 1e9 * tmax / b);
+            delete R;
+        }
+        printf ("\n");
+    }
+    delete[] inp;
+    delete[] out;
+}
+
+
+// Pitch detectors, accuracy on harmonic tones in semitone steps
+// from 65 to 1100 Hz, and time per call on a tone and on noise.
+// A gross error is one of more than 50 cents, the rms error is
+// computed over the other results, in cents. The CPU load is for
+// the normal profile.
+
+static void bench_findcycle (int fs)
+{
+    Pitchdet         *D;
+    float            *data;
+    int               d, i, j, k, size, ifmin, ifmax;
+    int               ntone, nfound, ngross, nfalse;
+    float             c, f, e, se;
+    double            t, tsum [2], tmax [2];
+    struct timespec   t0, t1;
+
+    // Same analysis parameters as the Retuner, which
+    // decimates to 44.1 or 48 kHz at the higher rates.
+    if (fs >= 128000) fs /= 4;
+    else if (fs >= 64000) fs /= 2;
+    size = 2048;
+    ifmin = fs / 1200;
+    ifmax = fs / 60;
+    data = new float [size];
+
+    printf ("\nfindcycle, analysis at %d Hz, %d samples, lags %d..%d, %.1lf calls/s\n",
+            fs, size, ifmin, ifmax, 4.0 * fs / size);
+    printf ("detector   tone us/call  worst  noise us/call  worst   %%CPU   found   gross  rms err   false\n");
+
+    for (d = 0; d < Pitchdet::NTYPE; d++)
+    {
+        D = Pitchdet::create (d, fs, size, ifmin, ifmax);
+
+        ntone = nfound = ngross = 0;
+        se = 0;
+        for (k = 0; (f = 65.0f * powf (2.0f, k / 12.0f)) < 1100.0f; k++)
+        {
+            for (i = 0; i < 4; i++)
+            {
+                gentone (data, size, fs, f, 0, 4 * k + i);
+                c = D->findcycle (data);
+                ntone++;
+                if (c == 0) continue;
+                nfound++;
+                e = 1200 * log2f (fs / (c * f));
+                if (fabsf (e) > 50) ngross++;
+                else se += e * e;
+            }
+        }
+        nfalse = 0;
+        for (i = 0; i < 100; i++)
+        {
+            gennoise (data, size, 1000 + i);
+            if (D->findcycle (data) != 0) nfalse++;
+        }
+
+        for (j = 0; j < 2; j++)
+        {
+            if (j) gennoise (data, size, 0);
+            else gentone (data, size, fs, 220.0f, 0, 0);
+            tsum [j] = tmax [j] = 0;
+            for (i = 0; i < ncalls; i++)
+            {
+                clock_gettime (CLOCK_MONOTONIC, &t0);
+                D->findcycle (data);
+                clock_gettime (CLOCK_MONOTONIC, &t1);
+                t = timediff (&t0, &t1);
+                tsum [j] += t;
+                if (t > tmax [j]) tmax [j] = t;
+            }
+        }
+
+        printf ("%-8s %14.1lf %6.1lf %14.1lf %6.1lf %6.2lf %4d/%-3d %6d %8.2f %4d/100\n",
+                Pitchdet::name (d), 1e6 * tsum [0] / ncalls, 1e6 * tmax [0],
+                1e6 * tsum [1] / ncalls, 1e6 * tmax [1],
+                100 * tsum [0] / ncalls * 4.0 * fs / size,
+                nfound, ntone, ngross, (nfound > ngross) ? sqrtf (se / (nfound - ngross)) : 0.0f, nfalse);
+        delete D;
+    }
+    delete[] data;
+}
+
+
+// Retuner::finderror(), timed in batches of 100 calls to stay
+// well above the clock resolution.
+
+static void bench_finderror (int fs)
+{
+    Retuner          *R;
+    float            cycle [100];
+    int               i, j, m;
+    double            t, tsum, tmax;
+    struct timespec   t0, t1;
+
+    R = new Retuner (fs);
+    srand (3);
+    for (i = 0; i < 100; i++) cycle [i] = fs / (65.0f + 1000.0f * urand ());
+    printf ("\nfinderror, %d Hz, ns/call\n", fs);
+    printf ("notemask      mean   worst\n");
+    for (m = 0; m < 2; m++)
+    {
+        R->set_notemask (m ? 0x0A5 : 0xFFF);
+        tsum = tmax = 0;
+        for (j = 0; j < (ncalls + 99) / 100; j++)
+        {
+            clock_gettime (CLOCK_MONOTONIC, &t0);
+            for (i = 0; i < 100; i++)
+            {
+                Retuner_bench::set_cycle (R, cycle [i]);
+                Retuner_bench::finderror (R);
+            }
+            clock_gettime (CLOCK_MONOTONIC, &t1);
+            t = timediff (&t0, &t1);
+            tsum += t;
+            if (t > tmax) tmax = t;
+        }
+        printf ("   0x%03X %9.1lf %7.1lf\n", m ? 0x0A5 : 0xFFF, 1e7 * tsum / j, 1e7 * tmax);
+    }
+    delete R;
+}
+
+
+// Interpolation kernels at all levels supported by this CPU, speed
+// and maximum difference from the scalar version.
+
+static void bench_cubic (void)
+{
+    float            *buff, *xf, *out, *ref [2];
+    int               i, j, k, lev, size, n;
+    float             r1, r2, e [2];
+    double            t [2];
+    struct timespec   t0, t1;
+
+    size = 4096;
+    n = 256;
+    buff = new float [size + 3];
+    xf = new float [n];
+    out = new float [n];
+    ref [0] = new float [n];
+    ref [1] = new float [n];
+    gentone (buff, size, 48000, 233.0f, 0, 1);
+    for (i = 0; i < 3; i++) buff [size + i] = buff [i];
+    for (i = 0; i < n; i++) xf [i] = 0.5f * (1 - cosf (M_PI * i / n));
+
+    printf ("\nInterpolation, ns/sample, max difference from scalar\n");
+    printf ("level       cubic       diff   xfade       diff\n");
+    for (lev = 0; lev < INTERP_NLEVEL; lev++)
+    {
+        if (interp_init (lev) < 0) continue;
+        for (j = 0; j < 2; j++)
+        {
+            // Wrap around the end of the buffer during the test.
+            r1 = size - 100.3f;
+            r2 = size / 2 + 0.7f;
+            if (j) interp_xfade (buff, size, &r1, &r2, 1.0594f, xf, out, n);
+            else interp_cubic (buff, size, &r1, 1.0594f, out, n);
+            if (lev == INTERP_SCALAR) memcpy (ref [j], out, n * sizeof (float));
+            for (i = 0, e [j] = 0; i < n; i++) e [j] = fmaxf (e [j], fabsf (out [i] - ref [j][i]));
+            k = 0;
+            clock_gettime (CLOCK_MONOTONIC, &t0);
+            for (i = 0; i < 50 * ncalls; i++)
+            {
+                if (j) interp_xfade (buff, size, &r1, &r2, 1.0594f, xf, out, n);
+                else interp_cubic (buff, size, &r1, 1.0594f, out, n);
+                k += n;
+            }
+            clock_gettime (CLOCK_MONOTONIC, &t1);
+            t [j] = timediff (&t0, &t1) / k;
+        }
+        printf ("%-8s %8.2lf %10.1e %7.2lf %10.1e\n", interp_name (lev), 1e9 * t [0], e [0], 1e9 * t [1], e [1]);
+    }
+    delete[] buff;
+    delete[] xf;
+    delete[] out;
+    delete[] ref [0];
+    delete[] ref [1];
+}
+
+
+int main (int ac, char *av [])
+{
+    int  i, fs, best;
+
+    procoptions (ac, av);
+
+    best = interp_init (INTERP_AUTO);
+    printf ("Interpolation code: %s\n", interp_name (best));
+    bench_cubic ();
+    interp_init (best);
+    for (i = 0; rates [i]; i++)
+    {
+        fs = fsamp ? fsamp : rates [i];
+        bench_finderror (fs);
+        bench_findcycle (fs);
+        bench_process (fs);
+        if (fsamp) break;
+    }
+
+    return 0;
+}
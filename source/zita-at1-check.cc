@@ -0,0 +1,188 @@
+// ----------------------------------------------------------------------
+//
+//  Copyright (C) 2010-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// ----------------------------------------------------------------------
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "interp.h"
+
+
+// Accuracy test of the interpolation code. Every level supported
+// by this CPU is compared to the scalar one, on random data and at
+// the edge cases: positions just before the end of the buffer, so
+// the taps and the read position wrap, and lengths that are not a
+// multiple of the vector size. The read positions must be the same
+// as for the scalar code, the output within TOLER of it, relative
+// to the peak input level. Returns non-zero if any test fails.
+
+
+#define TOLER 1e-5f
+
+
+enum { MAXN = 1024, NRAND = 2000 };
+
+static const int    sizes [] = { 4096, 8192, 16384, 1000 };
+static const float  ratios [] = { 1.0f, 2.0f, 0.5f, 1.0594631f, 0.9438743f, 2.1189262f, 1.8877487f, 0.0001f, 3.99f };
+static const float  edges [] = { 0.0f, 0.5f, 1.0f, 1.5f, 2.0f, 3.0f, 1e-3f, 0.999f, 4.0f, 100.3f };
+
+static int    nfail = 0;
+static float  maxerr [INTERP_NLEVEL][2];
+
+
+static float urand (void)
+{
+    return 2.0f * rand () / (float) RAND_MAX - 1.0f;
+}
+
+
+static void fill (float *buff, int size, int type)
+{
+    int i;
+
+    switch (type)
+    {
+    case 0:
+        for (i = 0; i < size; i++) buff [i] = urand ();
+        break;
+    case 1:
+        // Full scale square wave, largest steps.
+        for (i = 0; i < size; i++) buff [i] = (i & 1) ? 1.0f : -1.0f;
+        break;
+    default:
+        // Large values.
+        for (i = 0; i < size; i++) buff [i] = 1e4f * urand ();
+    }
+    // The three guard samples.
+    for (i = 0; i < 3; i++) buff [size + i] = buff [i];
+}
+
+
+static void compare (int lev, int xfade, const float *buff, int size, float peak,
+                     float r1, float r2, float dr, const float *xf, int n)
+{
+    float  a1, a2, b1, b2, e;
+    float  ref [MAXN], out [MAXN];
+    int    i;
+
+    a1 = b1 = r1;
+    a2 = b2 = r2;
+    interp_init (INTERP_SCALAR);
+    if (xfade) interp_xfade (buff, size, &a1, &a2, dr, xf, ref, n);
+    else interp_cubic (buff, size, &a1, dr, ref, n);
+    interp_init (lev);
+    if (xfade) interp_xfade (buff, size, &b1, &b2, dr, xf, out, n);
+    else interp_cubic (buff, size, &b1, dr, out, n);
+
+    for (i = 0, e = 0; i < n; i++) e = fmaxf (e, fabsf (out [i] - ref [i]));
+    e /= peak;
+    if (e > maxerr [lev][xfade]) maxerr [lev][xfade] = e;
+    if ((e > TOLER) || (a1 != b1) || (xfade && (a2 != b2)))
+    {
+        if (nfail++ < 10)
+        {
+            fprintf (stderr, "FAIL %s %s: size %d r1 %.6f r2 %.6f dr %.7f n %d: error %.2e, positions %.6f %.6f\n",
+                     interp_name (lev), xfade ? "xfade" : "cubic", size, r1, r2, dr, n, e,
+                     b1 - a1, xfade ? b2 - a2 : 0.0f);
+        }
+    }
+}
+
+
+static float position (int size, int k)
+{
+    // Edge cases before the end of the buffer, then random ones.
+    // The first one is the largest float below size, subtracting
+    // a small constant would round back to size for large buffers.
+    if (k == 0) return nextafterf ((float) size, 0.0f);
+    if (k < (int)(sizeof (edges) / sizeof (float))) return size - edges [k];
+    return (0.5f + 0.5f * urand ()) * size * 0.99999f;
+}
+
+
+int main (int ac, char *av [])
+{
+    float   *buff, xf [MAXN], peak, r1, r2, dr;
+    int     i, k, s, t, d, lev, n, size, ntest;
+
+    srand (1);
+    for (i = 0; i < MAXN; i++) xf [i] = 0.5f + 0.5f * urand ();
+    ntest = 0;
+    printf ("Interpolation accuracy, tolerance %.1e\n", TOLER);
+    for (lev = INTERP_SCALAR + 1; lev < INTERP_NLEVEL; lev++)
+    {
+        if (interp_init (lev) < 0)
+        {
+            printf ("%-8s not supported by this CPU\n", interp_name (lev));
+            continue;
+        }
+        for (s = 0; s < (int)(sizeof (sizes) / sizeof (int)); s++)
+        {
+            size = sizes [s];
+            buff = new float [size + 3];
+            for (t = 0; t < 3; t++)
+            {
+                fill (buff, size, t);
+                for (i = 0, peak = 0; i < size; i++) peak = fmaxf (peak, fabsf (buff [i]));
+                for (d = 0; d < (int)(sizeof (ratios) / sizeof (float)); d++)
+                {
+                    dr = ratios [d];
+                    for (k = 0; k < 40; k++)
+                    {
+                        r1 = position (size, k);
+                        r2 = position (size, 39 - k);
+                        // All lengths up to 67, then some longer ones.
+                        for (n = 1; n < 68; n++, ntest++)
+                        {
+                            compare (lev, 0, buff, size, peak, r1, r2, dr, xf, n);
+                            compare (lev, 1, buff, size, peak, r1, r2, dr, xf, n);
+                        }
+                        n = 68 + rand () % (MAXN - 68);
+                        compare (lev, 0, buff, size, peak, r1, r2, dr, xf, n);
+                        compare (lev, 1, buff, size, peak, r1, r2, dr, xf, n);
+                        ntest++;
+                    }
+                }
+            }
+            // Random ratios and positions.
+            fill (buff, size, 0);
+            for (i = 0, peak = 0; i < size; i++) peak = fmaxf (peak, fabsf (buff [i]));
+            for (k = 0; k < NRAND; k++, ntest++)
+            {
+                dr = 0.25f + 1.75f * (0.5f + 0.5f * urand ());
+                r1 = (0.5f + 0.5f * urand ()) * size * 0.99999f;
+                r2 = (0.5f + 0.5f * urand ()) * size * 0.99999f;
+                n = 1 + rand () % MAXN;
+                compare (lev, 0, buff, size, peak, r1, r2, dr, xf, n);
+                compare (lev, 1, buff, size, peak, r1, r2, dr, xf, n);
+            }
+            delete[] buff;
+        }
+        printf ("%-8s max error cubic %.2e, xfade %.2e\n", interp_name (lev), maxerr [lev][0], maxerr [lev][1]);
+    }
+    if (nfail)
+    {
+        printf ("%d of %d tests failed.\n", nfail, 2 * ntest);
+        return 1;
+    }
+    printf ("All %d tests passed.\n", 2 * ntest);
+    return 0;
+}
@@ -0,0 +1,235 @@
+// ----------------------------------------------------------------------
+//
+//  Copyright (C) 2010-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// ----------------------------------------------------------------------
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <lv2/lv2plug.in/ns/lv2core/lv2.h>
+#include <lv2/lv2plug.in/ns/ext/atom/atom.h>
+#include <lv2/lv2plug.in/ns/ext/atom/util.h>
+#include <lv2/lv2plug.in/ns/ext/midi/midi.h>
+#include <lv2/lv2plug.in/ns/ext/urid/urid.h>
+#include "retuner.h"
+#include "interp.h"
+
+
+#define AT1_URI "http://kokkinizita.linuxaudio.org/plugins/zita-at1"
+
+
+// Port numbers, these must match the ones in zita-at1.ttl.
+
+enum
+{
+    P_INP, P_OUT, P_MIDI,
+    P_TUNE, P_BIAS, P_FILT, P_CORR, P_OFFS,
+    P_NOTE, P_LATENCY = P_NOTE + 12,
+    NPORT
+};
+
+enum { C_TUNE, C_BIAS, C_FILT, C_CORR, C_OFFS, NCTRL };
+
+
+// The same engine as in zita-at1, but running in the host's
+// process thread. Pitch estimation is done in line, there is
+// no worker thread. The note mask is taken from the MIDI input
+// when any notes are on, and from the twelve note ports if not,
+// as in Jclient.
+
+class Lv2at1
+{
+public:
+
+    Lv2at1 (int fsamp, LV2_URID midi_event);
+    ~Lv2at1 (void);
+
+    void connect (uint32_t port, void *data) { _port [port] = (float *) data; }
+    void activate (void);
+    void run (int nframes);
+
+private:
+
+    void midi_process (void);
+
+    Retuner    *_retuner;
+    float      *_port [NPORT];
+    float       _ctrl [NCTRL];
+    int         _notes [12];
+    int         _midimask;
+    LV2_URID    _midi_event;
+};
+
+
+Lv2at1::Lv2at1 (int fsamp, LV2_URID midi_event) :
+    _midi_event (midi_event)
+{
+    memset (_port, 0, sizeof (_port));
+    _retuner = new Retuner (fsamp);
+    _retuner->start_planner ();
+    activate ();
+}
+
+
+Lv2at1::~Lv2at1 (void)
+{
+    delete _retuner;
+}
+
+
+void Lv2at1::activate (void)
+{
+    int i;
+
+    // Force all parameters to be sent on the next run().
+    for (i = 0; i < NCTRL; i++) _ctrl [i] = -1e30f;
+    for (i = 0; i < 12; i++) _notes [i] = 0;
+    _midimask = 0;
+}
+
+
+void Lv2at1::midi_process (void)
+{
+    int                 i, b, n, t, v;
+    const uint8_t       *d;
+    LV2_Atom_Sequence   *S;
+
+    S = (LV2_Atom_Sequence *)(_port [P_MIDI]);
+    if (S)
+    {
+        LV2_ATOM_SEQUENCE_FOREACH (S, E)
+        {
+            if ((E->body.type != _midi_event) || (E->body.size < 3)) continue;
+            d = (const uint8_t *)(E + 1);
+            t = d [0];
+            n = d [1];
+            v = d [2];
+            switch (t & 0xF0)
+            {
+            case 0x80:
+            case 0x90:
+                if (v && (t & 0x10))
+                {
+                    _notes [n % 12] += 1;
+                }
+                else if (_notes [n % 12])
+                {
+                    _notes [n % 12] -= 1;
+                }
+                break;
+            }
+        }
+    }
+
+    _midimask = 0;
+    for (i = 0, b = 1; i < 12; i++, b <<= 1)
+    {
+        if (_notes [i]) _midimask |= b;
+    }
+}
+
+
+void Lv2at1::run (int nframes)
+{
+    int    i, b, m;
+    float  v;
+
+    // Only pass parameters that have changed. This is the
+    // process thread, so use set_param() which doesn't take
+    // the parameter mutex.
+    v = *_port [P_TUNE];
+    if (v != _ctrl [C_TUNE]) _retuner->set_param (Retuner::PAR_REFPITCH, _ctrl [C_TUNE] = v);
+    v = *_port [P_BIAS];
+    if (v != _ctrl [C_BIAS]) _retuner->set_param (Retuner::PAR_NOTEBIAS, _ctrl [C_BIAS] = v);
+    v = *_port [P_FILT];
+    if (v != _ctrl [C_FILT]) _retuner->set_param (Retuner::PAR_CORRFILT, _ctrl [C_FILT] = v);
+    v = *_port [P_CORR];
+    if (v != _ctrl [C_CORR]) _retuner->set_param (Retuner::PAR_CORRGAIN, _ctrl [C_CORR] = v);
+    v = *_port [P_OFFS];
+    if (v != _ctrl [C_OFFS]) _retuner->set_param (Retuner::PAR_CORROFFS, _ctrl [C_OFFS] = v);
+
+    midi_process ();
+    m = 0;
+    for (i = 0, b = 1; i < 12; i++, b <<= 1)
+    {
+        if (*_port [P_NOTE + i] > 0.5f) m |= b;
+    }
+    _retuner->set_notemask (_midimask ? _midimask : m);
+    _retuner->process (nframes, _port [P_INP], _port [P_OUT]);
+    if (_port [P_LATENCY]) *_port [P_LATENCY] = _retuner->latency ();
+}
+
+
+static LV2_Handle instantiate (const LV2_Descriptor *, double fsamp, const char *,
+                               const LV2_Feature * const *features)
+{
+    LV2_URID_Map  *map;
+    int           i;
+
+    map = 0;
+    for (i = 0; features [i]; i++)
+    {
+        if (!strcmp (features [i]->URI, LV2_URID__map)) map = (LV2_URID_Map *)(features [i]->data);
+    }
+    if (! map) return 0;
+    interp_init (INTERP_AUTO);
+    return (LV2_Handle) new Lv2at1 ((int)(fsamp + 0.5), map->map (map->handle, LV2_MIDI__MidiEvent));
+}
+
+
+static void connect_port (LV2_Handle H, uint32_t port, void *data)
+{
+    if (port < NPORT) ((Lv2at1 *) H)->connect (port, data);
+}
+
+
+static void activate (LV2_Handle H)
+{
+    ((Lv2at1 *) H)->activate ();
+}
+
+
+static void run (LV2_Handle H, uint32_t nframes)
+{
+    ((Lv2at1 *) H)->run (nframes);
+}
+
+
+static void cleanup (LV2_Handle H)
+{
+    delete (Lv2at1 *) H;
+}
+
+
+static const LV2_Descriptor descriptor =
+{
+    AT1_URI,
+    instantiate,
+    connect_port,
+    activate,
+    run,
+    0,
+    cleanup,
+    0
+};
+
+
+LV2_SYMBOL_EXPORT const LV2_Descriptor *lv2_descriptor (uint32_t index)
+{
+    return index ? 0 : &descriptor;
+}
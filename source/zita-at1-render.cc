@@ -0,0 +1,263 @@
+// ----------------------------------------------------------------------
+//
+//  Copyright (C) 2010-2011 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// ----------------------------------------------------------------------
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sndfile.h>
+#include "retuner.h"
+#include "interp.h"
+#include "ctlparams.h"
+
+
+#define PROGNAME "zita-at1-render"
+
+
+static int    notemask = 0xFFF;
+static float  refpitch = 440.0f;
+static float  notebias = 0.5f;
+static float  corrfilt = 0.1f;
+static float  corrgain = 1.0f;
+static float  corroffs = 0.0f;
+static int    blocksize = 256;
+static bool   verbose = false;
+static bool   freewheel = false;
+static int    simdlevel = INTERP_AUTO;
+static int    detector = Pitchdet::FFT;
+static int    profile = Retuner::PROF_NORMAL;
+
+
+static void help (void)
+{
+    fprintf (stderr, "\n%s-%s\n\n", PROGNAME, VERSION);
+    fprintf (stderr, "  (C) 2010-2011 Fons Adriaensen  <fons@linuxaudio.org>\n\n");
+    fprintf (stderr, "Usage: %s <options> <input file> <output file>\n\n", PROGNAME);
+    fprintf (stderr, "Options:\n");
+    fprintf (stderr, "  -h              Display this text\n");
+    fprintf (stderr, "  -m <mask>       Note mask, bit 0 = C ... bit 11 = B [0xFFF]\n");
+    fprintf (stderr, "  -t <freq>       Tuning, frequency of A [440]\n");
+    fprintf (stderr, "  -b <bias>       Bias, 0..1 [0.5]\n");
+    fprintf (stderr, "  -f <filt>       Filter, 0.02..0.5 [0.1]\n");
+    fprintf (stderr, "  -c <corr>       Correction, 0..1 [1.0]\n");
+    fprintf (stderr, "  -o <offs>       Offset in semitones, -2..2 [0.0]\n");
+    fprintf (stderr, "  -B <frames>     Processing block size [256]\n");
+    fprintf (stderr, "  -S <name>       Interpolation code: scalar, sse2, avx2, avx512 [auto]\n");
+    fprintf (stderr, "  -D <name>       Pitch detector: fft, mpm [fft]\n");
+    fprintf (stderr, "  -P <name>       Profile: normal, lowlat, accurate [normal]\n");
+    fprintf (stderr, "  -H              Use hugepages for the DSP buffers\n");
+    fprintf (stderr, "  -F              Estimate the pitch at every fragment\n");
+    fprintf (stderr, "  -v              Report processing speed\n");
+    exit (1);
+}
+
+
+static void checkrange (const char *name, int k, float v)
+{
+    // The ranges of the GUI controls.
+    if ((v >= ctlparams [k].vmin) && (v <= ctlparams [k].vmax)) return;
+    fprintf (stderr, "%s must be in the range %g..%g.\n", name, ctlparams [k].vmin, ctlparams [k].vmax);
+    exit (1);
+}
+
+
+static void procoptions (int ac, char *av [])
+{
+    int k, i;
+
+    while ((k = getopt (ac, av, "hm:t:b:f:c:o:B:S:D:P:HFv")) != -1)
+    {
+        switch (k)
+        {
+        case 'h': help ();
+        case 'm': notemask = strtol (optarg, 0, 0) & 0xFFF; break;
+        case 't': refpitch = atof (optarg); break;
+        case 'b': notebias = atof (optarg); break;
+        case 'f': corrfilt = atof (optarg); break;
+        case 'c': corrgain = atof (optarg); break;
+        case 'o': corroffs = atof (optarg); break;
+        case 'B': blocksize = atoi (optarg); break;
+        case 'S':
+            for (i = 0; (i < INTERP_NLEVEL) && strcmp (optarg, interp_name (i)); i++);
+            if (i == INTERP_NLEVEL) help ();
+            simdlevel = i;
+            break;
+        case 'D':
+            if ((detector = Pitchdet::find (optarg)) < 0) help ();
+            break;
+        case 'P':
+            if ((profile = Retuner::profile_find (optarg)) < 0) help ();
+            break;
+        case 'H': Arena::set_hugepages (true); break;
+        case 'F': freewheel = true; break;
+        case 'v': verbose = true; break;
+        default: help ();
+        }
+    }
+    if (ac - optind != 2) help ();
+    checkrange ("Tuning", CTL_TUNE, refpitch);
+    checkrange ("Bias", CTL_BIAS, notebias);
+    checkrange ("Filter", CTL_FILT, corrfilt);
+    checkrange ("Correction", CTL_CORR, corrgain);
+    checkrange ("Offset", CTL_OFFS, corroffs);
+    if ((blocksize < 1) || (blocksize > 65536))
+    {
+        fprintf (stderr, "Block size must be in the range 1..65536.\n");
+        exit (1);
+    }
+    if (interp_init (simdlevel) < 0)
+    {
+        fprintf (stderr, "This CPU does not support %s.\n", interp_name (simdlevel));
+        exit (1);
+    }
+}
+
+
+static double timediff (struct timespec *t0, struct timespec *t1)
+{
+    return (t1->tv_sec - t0->tv_sec) + 1e-9 * (t1->tv_nsec - t0->tv_nsec);
+}
+
+
+int main (int ac, char *av [])
+{
+    SNDFILE          *inpfile;
+    SNDFILE          *outfile;
+    SF_INFO           info;
+    Retuner          **retuner;
+    float            *inpbuff, *outbuff, **chinp, **choutp;
+    int               c, i, j, k, nchan, skip, flush;
+    long long         nfram;
+    double            tproc, ttot;
+    struct timespec   t0, t1, t2;
+
+    procoptions (ac, av);
+
+    memset (&info, 0, sizeof (info));
+    inpfile = sf_open (av [optind], SFM_READ, &info);
+    if (! inpfile)
+    {
+        fprintf (stderr, "Can't open input file '%s'.\n", av [optind]);
+        return 1;
+    }
+    outfile = sf_open (av [optind + 1], SFM_WRITE, &info);
+    if (! outfile)
+    {
+        fprintf (stderr, "Can't open output file '%s'.\n", av [optind + 1]);
+        sf_close (inpfile);
+        return 1;
+    }
+
+    // One Retuner per channel, all with the same settings.
+    nchan = info.channels;
+    retuner = new Retuner * [nchan];
+    for (c = 0; c < nchan; c++)
+    {
+        retuner [c] = new Retuner (info.samplerate, detector, profile);
+        retuner [c]->set_refpitch (refpitch);
+        retuner [c]->set_notebias (notebias);
+        retuner [c]->set_corrfilt (corrfilt);
+        retuner [c]->set_corrgain (corrgain);
+        retuner [c]->set_corroffs (corroffs);
+        retuner [c]->set_notemask (notemask);
+        retuner [c]->set_freewheel (freewheel);
+    }
+    inpbuff = new float [nchan * blocksize];
+    outbuff = new float [nchan * blocksize];
+    chinp   = new float * [nchan];
+    choutp  = new float * [nchan];
+    for (c = 0; c < nchan; c++)
+    {
+        chinp [c]  = new float [blocksize];
+        choutp [c] = new float [blocksize];
+    }
+
+    // The output is delayed by the Retuner latency. Drop that many
+    // frames at the start, and flush the same number of zero input
+    // frames at the end, so the output is aligned with the input
+    // and has the same length.
+    skip = flush = retuner [0]->latency ();
+    nfram = 0;
+    tproc = 0;
+    clock_gettime (CLOCK_MONOTONIC, &t0);
+    while (true)
+    {
+        k = sf_readf_float (inpfile, inpbuff, blocksize);
+        if (k <= 0)
+        {
+            if (! flush) break;
+            k = (flush < blocksize) ? flush : blocksize;
+            memset (inpbuff, 0, nchan * k * sizeof (float));
+            flush -= k;
+        }
+        for (c = 0; c < nchan; c++)
+        {
+            for (i = 0; i < k; i++) chinp [c][i] = inpbuff [i * nchan + c];
+        }
+        clock_gettime (CLOCK_MONOTONIC, &t1);
+        for (c = 0; c < nchan; c++) retuner [c]->process (k, chinp [c], choutp [c]);
+        clock_gettime (CLOCK_MONOTONIC, &t2);
+        tproc += timediff (&t1, &t2);
+        nfram += k;
+        j = (skip < k) ? skip : k;
+        skip -= j;
+        for (c = 0; c < nchan; c++)
+        {
+            for (i = j; i < k; i++) outbuff [(i - j) * nchan + c] = choutp [c][i];
+        }
+        if (sf_writef_float (outfile, outbuff, k - j) != k - j)
+        {
+            fprintf (stderr, "Error writing output file: %s\n", sf_strerror (outfile));
+            break;
+        }
+    }
+    clock_gettime (CLOCK_MONOTONIC, &t2);
+    ttot = timediff (&t0, &t2);
+
+    if (verbose && (tproc > 0))
+    {
+        printf ("%lld frames, %d channels, %d Hz, %s\n", nfram, nchan, info.samplerate,
+                interp_name (interp_init (INTERP_AUTO)));
+        printf ("Profile %s, latency %d frames (%.1lf ms)\n", Retuner::profile_name (profile),
+                retuner [0]->latency (), 1e3 * retuner [0]->latency () / info.samplerate);
+        printf ("Engine : %8.3lf s, %12.0lf samples/s, %8.1lf x realtime\n",
+                tproc, nfram * nchan / tproc, nfram / (tproc * info.samplerate));
+        printf ("Total  : %8.3lf s, %12.0lf samples/s, %8.1lf x realtime\n",
+                ttot, nfram * nchan / ttot, nfram / (ttot * info.samplerate));
+    }
+
+    sf_close (inpfile);
+    sf_close (outfile);
+    for (c = 0; c < nchan; c++)
+    {
+        delete retuner [c];
+        delete[] chinp [c];
+        delete[] choutp [c];
+    }
+    delete[] retuner;
+    delete[] chinp;
+    delete[] choutp;
+    delete[] inpbuff;
+    delete[] outbuff;
+
+    return 0;
+}
@@ -28,10 +28,11 @@
 #include "styles.h"
 #include "jclient.h"
 #include "mainwin.h"
+#include "headless.h"
 #include "nsm.h"
 
 
-#define NOPTS 3
+#define NOPTS 19
 #define CP (char *)
 
 
@@ -39,13 +40,30 @@ XrmOptionDescRec options [NOPTS] =
 {
     {CP"-h",    CP".help",      XrmoptionNoArg,   CP"true" },
     {CP"-g",    CP".geometry",  XrmoptionSepArg,  0        },
-    {CP"-s",    CP".server",    XrmoptionSepArg,  0        }
+    {CP"-s",    CP".server",    XrmoptionSepArg,  0        },
+    {CP"-A",    CP".async",     XrmoptionNoArg,   CP"true" },
+    {CP"-F",    CP".spread",    XrmoptionNoArg,   CP"true" },
+    {CP"-D",    CP".detector",  XrmoptionSepArg,  0        },
+    {CP"-P",    CP".profile",   XrmoptionSepArg,  0        },
+    {CP"-T",    CP".smoothing", XrmoptionSepArg,  0        },
+    {CP"-M",    CP".timing",    XrmoptionNoArg,   CP"true" },
+    {CP"-H",    CP".hugepages", XrmoptionNoArg,   CP"true" },
+    {CP"-V",    CP".voices",    XrmoptionSepArg,  0        },
+    {CP"-I",    CP".intervals", XrmoptionSepArg,  0        },
+    {CP"-C",    CP".cvout",     XrmoptionNoArg,   CP"true" },
+    {CP"-L",    CP".dryout",    XrmoptionNoArg,   CP"true" },
+    {CP"-d",    CP".headless",  XrmoptionNoArg,   CP"true" },
+    {CP"-c",    CP".control",   XrmoptionSepArg,  0        },
+    {CP"-f",    CP".statefile", XrmoptionSepArg,  0        },
+    {CP"-O",    CP".oscport",   XrmoptionSepArg,  0        },
+    {CP"-N",    CP".channels",  XrmoptionSepArg,  0        }
 };
 
 
 
 static Jclient  *jclient = 0;
 Mainwin  *mainwin = 0;
+Headless *headless = 0;
 NSM_Client *nsm = 0;
 
 
@@ -58,14 +76,120 @@ static void help (void)
     fprintf (stderr, "  -name <name>    Jack client name\n");
     fprintf (stderr, "  -s <server>     Jack server name\n");
     fprintf (stderr, "  -g <geometry>   Window position\n");
+    fprintf (stderr, "  -A              Pitch estimation in separate thread\n");
+    fprintf (stderr, "  -F              Pitch estimation spread over fragments\n");
+    fprintf (stderr, "  -D <name>       Pitch detector: fft, mpm [fft]\n");
+    fprintf (stderr, "  -P <name>       Profile: normal, lowlat, accurate [normal]\n");
+    fprintf (stderr, "  -T <ms>         Parameter smoothing time [0]\n");
+    fprintf (stderr, "  -M              Print DSP timing on exit and on SIGUSR1\n");
+    fprintf (stderr, "  -H              Use hugepages for the DSP buffers\n");
+    fprintf (stderr, "  -V <count>      Harmony voices, 0..4 [0]\n");
+    fprintf (stderr, "  -I <list>       Harmony intervals in semitones [4,7,12,-12]\n");
+    fprintf (stderr, "  -C              Add a pitch control signal output\n");
+    fprintf (stderr, "  -L              Add a latency compensated dry output\n");
+    fprintf (stderr, "  -d              Headless, run without a display\n");
+    fprintf (stderr, "  -c <path>       Control socket, headless only\n");
+    fprintf (stderr, "  -f <file>       State file if not in a session, headless only\n");
+    fprintf (stderr, "  -O <port>       OSC control on this UDP port\n");
+    fprintf (stderr, "  -N <count>      Number of channels, 1..64 [1]\n");
     exit (1);
 }
 
 
+static volatile sig_atomic_t report = 0;
+
+
 static void sigint_handler (int)
 {
     signal (SIGINT, SIG_IGN);
-    mainwin->stop ();
+    if (mainwin) mainwin->stop ();
+    if (headless) headless->stop ();
+}
+
+
+static void sigusr1_handler (int)
+{
+    report = 1;
+}
+
+
+static void set_intervals (Jclient *J, const char *p)
+{
+    int    i;
+    char   *q;
+
+    for (i = 0; i < Retuner::MAXVOICE; i++)
+    {
+        J->set_interval (i, strtof (p, &q));
+        if (*q != ',') break;
+        p = q + 1;
+    }
+}
+
+
+static Jclient *make_jclient (X_resman *xresman, int pd, int pr)
+{
+    int         es, po;
+    const char  *p;
+    Jclient     *J;
+
+    Arena::set_hugepages (xresman->getb (".hugepages", 0));
+    po = 0;
+    if (xresman->getb (".cvout", 0))  po |= Jclient::PORT_CV;
+    if (xresman->getb (".dryout", 0)) po |= Jclient::PORT_DRY;
+    es = Jclient::EST_INLINE;
+    if (xresman->getb (".spread", 0)) es = Jclient::EST_SPREAD;
+    if (xresman->getb (".async", 0))  es = Jclient::EST_ASYNC;
+    J = new Jclient (xresman->rname (), xresman->get (".server", 0), es, pd, pr,
+                     atoi (xresman->get (".voices", "0")), po,
+                     atoi (xresman->get (".channels", "1")));
+    set_intervals (J, xresman->get (".intervals", "4,7,12,-12"));
+    J->set_smoothing (1e-3f * atof (xresman->get (".smoothing", "0")));
+    if ((p = xresman->get (".oscport", 0)))
+    {
+        if (J->start_osc (p)) fprintf (stderr, "Warning: can't start OSC server on port %s.\n", p);
+        else printf ("OSC control at %s\n", J->osc_url ());
+    }
+    return J;
+}
+
+
+static int run_headless (X_resman *xresman, int pd, int pr, bool managed, const string &state_file)
+{
+    const char  *p;
+
+    // No display, fonts or images. Parameters come from the state
+    // file, the control socket and MIDI.
+    jclient = make_jclient (xresman, pd, pr);
+    headless = new Headless (jclient, xresman->get (".control", 0));
+    if (managed) headless->set_statefile (state_file);
+    else if ((p = xresman->get (".statefile", 0))) headless->set_statefile (p);
+    headless->load_state ();
+
+    if (mlockall (MCL_CURRENT | MCL_FUTURE)) fprintf (stderr, "Warning: memory lock failed.\n");
+    signal (SIGINT, sigint_handler); 
+    signal (SIGTERM, sigint_handler); 
+    if (xresman->getb (".timing", 0)) signal (SIGUSR1, sigusr1_handler);
+
+    while (headless->process () != EV_EXIT)
+    {
+        if (nsm) nsm->check ();
+        if (report)
+        {
+            report = 0;
+            jclient->report (stdout);
+            fflush (stdout);
+        }
+    }
+
+    if (xresman->getb (".timing", 0)) jclient->report (stdout);
+
+    delete headless;
+    headless = 0;
+    delete jclient;
+    if (nsm) delete nsm;
+
+    return 0;
 }
 
 
@@ -75,7 +199,7 @@ int main (int ac, char *av [])
     X_display     *display;
     X_handler     *handler;
     X_rootwin     *rootwin;
-    int           ev, xp, yp, xs, ys;
+    int           ev, xp, yp, xs, ys, pd, pr;
     char          *nsm_url;
     string        program_name = PROGNAME;
     string        state_file ="";
@@ -113,6 +237,11 @@ int main (int ac, char *av [])
 
     xresman.init (&ac, av, CP program_name.c_str(), options, NOPTS);
     if (xresman.getb (".help", 0)) help ();
+    pd = Pitchdet::find (xresman.get (".detector", "fft"));
+    if (pd < 0) help ();
+    pr = Retuner::profile_find (xresman.get (".profile", "normal"));
+    if (pr < 0) help ();
+    if (xresman.getb (".headless", 0)) return run_headless (&xresman, pd, pr, managed, state_file);
             
     display = new X_display (xresman.get (".display", 0));
     if (display->dpy () == 0)
@@ -128,7 +257,7 @@ int main (int ac, char *av [])
     xresman.geometry (".geometry", display->xsize (), display->ysize (), 1, xp, yp, xs, ys);
 
     styles_init (display, &xresman);
-    jclient = new Jclient (xresman.rname (), xresman.get (".server", 0));
+    jclient = make_jclient (&xresman, pd, pr);
     rootwin = new X_rootwin (display);
     mainwin = new Mainwin (rootwin, &xresman, xp, yp, jclient);
     rootwin->handle_event ();
@@ -139,6 +268,7 @@ int main (int ac, char *av [])
 
     if (mlockall (MCL_CURRENT | MCL_FUTURE)) fprintf (stderr, "Warning: memory lock failed.\n");
     signal (SIGINT, sigint_handler); 
+    if (xresman.getb (".timing", 0)) signal (SIGUSR1, sigusr1_handler);
 
     mainwin->set_managed (managed);
     if (managed)
@@ -160,9 +290,17 @@ int main (int ac, char *av [])
             rootwin->handle_event ();
         }
         if (nsm) nsm->check ();
+        if (report)
+        {
+            report = 0;
+            jclient->report (stdout);
+            fflush (stdout);
+        }
     }
     while (ev != EV_EXIT);
 
+    if (xresman.getb (".timing", 0)) jclient->report (stdout);
+
     styles_fini (display);
     delete jclient;
     delete handler;